@@ -3,6 +3,7 @@
  */
 
 #include <cassert>
+#include <chrono>
 #include <cstdio>
 
 #include "api.h"
@@ -10,17 +11,25 @@
 #include "R/Funtab.h"
 #include "R/Serialize.h"
 #include "compiler/compiler.h"
+#include "compiler/native/jit_queue.h"
 #include "compiler/parameter.h"
 #include "compiler/pir2rir/pir2rir.h"
 #include "compiler/test/PirCheck.h"
 #include "compiler/test/PirTests.h"
+#include "compiler/util/arena.h"
+#include "interpreter/code_cache.h"
+#include "interpreter/instance.h"
 #include "interpreter/interp_incl.h"
+#include "interpreter/profiler.h"
 #include "ir/BC.h"
 #include "ir/Compiler.h"
 
+#include <algorithm>
 #include <list>
 #include <memory>
+#include <sstream>
 #include <string>
+#include <vector>
 
 using namespace rir;
 
@@ -124,6 +133,7 @@ REXPORT SEXP rir_markFunction(SEXP what, SEXP which, SEXP reopt_,
         if (reopt) {
             fun->flags.set(Function::MarkOpt);
             fun->flags.reset(Function::NotOptimizable);
+            fun->disableDirectCalls();
         } else {
             fun->flags.reset(Function::MarkOpt);
         }
@@ -273,38 +283,50 @@ REXPORT SEXP pir_setDebugFlags(SEXP debugFlags) {
     return R_NilValue;
 }
 
-SEXP pirCompile(SEXP what, const Context& assumptions, const std::string& name,
-                const pir::DebugOptions& debug) {
-    if (!isValidClosureSEXP(what)) {
-        Rf_error("not a compiled closure");
-    }
-    if (!DispatchTable::check(BODY(what))) {
-        Rf_error("Cannot optimize compiled expression, only closure");
-    }
-
-    PROTECT(what);
-
+static void pirCompileModule(SEXP what, const Context& assumptions,
+                             const std::string& name,
+                             const pir::DebugOptions& debug) {
     bool dryRun = debug.includes(pir::DebugFlag::DryRun);
     // compile to pir
     pir::Module* m = new pir::Module;
     pir::StreamLogger logger(debug);
     logger.title("Compiling " + name);
     pir::Compiler cmp(m, logger);
+
+    // Measure the compilation stages for rir.stats
+    typedef std::chrono::steady_clock Clock;
+    auto lap = [](Clock::time_point& since) {
+        auto now = Clock::now();
+        std::chrono::duration<double> duration = now - since;
+        since = now;
+        return duration.count();
+    };
+    FunctionStats stats;
+    auto timer = Clock::now();
+
     cmp.compileClosure(what, name, assumptions,
                        [&](pir::ClosureVersion* c) {
+                           stats.rir2pirTime = lap(timer);
                            logger.flush();
                            cmp.optimizeModule();
+                           stats.optTime = lap(timer);
 
                            // compile back to rir
                            pir::Pir2RirCompiler p2r(logger);
                            auto fun = p2r.compile(c, dryRun);
+                           if (pir::Parameter::PIR_ASYNC_COMPILE)
+                               pir::JitQueue::flush();
+                           stats.llvmTime = p2r.llvmTime;
+                           stats.pir2rirTime = lap(timer) - p2r.llvmTime;
 
                            // Install
                            if (dryRun)
                                return;
 
+                           fun->stats(stats);
                            Protect p(fun->container());
                            DispatchTable::unpack(BODY(what))->insert(fun);
+                           CodeCache::store(what);
                        },
                        [&]() {
                            if (debug.includes(pir::DebugFlag::ShowWarnings))
@@ -313,6 +335,20 @@ SEXP pirCompile(SEXP what, const Context& assumptions, const std::string& name,
                        {});
 
     delete m;
+}
+
+SEXP pirCompile(SEXP what, const Context& assumptions, const std::string& name,
+                const pir::DebugOptions& debug) {
+    if (!isValidClosureSEXP(what)) {
+        Rf_error("not a compiled closure");
+    }
+    if (!DispatchTable::check(BODY(what))) {
+        Rf_error("Cannot optimize compiled expression, only closure");
+    }
+
+    PROTECT(what);
+    pir::Arena::withCleanup(
+        [&]() { pirCompileModule(what, assumptions, name, debug); });
     UNPROTECT(1);
     return what;
 }
@@ -331,6 +367,85 @@ REXPORT SEXP rir_invocation_count(SEXP what) {
     return res;
 }
 
+static size_t bytecodeSize(Code* c) {
+    size_t size = c->codeSize;
+    for (unsigned i = 0; i < c->extraPoolSize; ++i) {
+        if (auto prom = Code::check(c->getExtraPoolEntry(i)))
+            size += bytecodeSize(prom);
+    }
+    return size;
+}
+
+REXPORT SEXP rir_stats(SEXP what) {
+    if (!isValidClosureSEXP(what)) {
+        Rf_error("not a compiled closure");
+    }
+    auto dt = DispatchTable::check(BODY(what));
+    assert(dt);
+
+    static const char* columns[] = {
+        "context",         "rir2pir",        "opt",
+        "pir2rir",         "llvm",           "bytecode",
+        "native",          "invocations",    "deopts",
+        "deopt.typecheck", "deopt.calltarget", "deopt.envstub",
+        "deopt.deadbranch", "native.tierup", "samples",
+        "argmatch",        "argmatch.wasted", "osr"};
+    static const SEXPTYPE types[] = {
+        STRSXP, REALSXP, REALSXP, REALSXP, REALSXP, INTSXP, LGLSXP, INTSXP,
+        INTSXP, INTSXP,  INTSXP,  INTSXP,  INTSXP,  LGLSXP, INTSXP, INTSXP,
+        INTSXP, INTSXP};
+    constexpr size_t ncol = sizeof(columns) / sizeof(columns[0]);
+    static_assert(ncol == sizeof(types) / sizeof(types[0]), "");
+
+    size_t n = dt->size();
+    SEXP res = PROTECT(Rf_allocVector(VECSXP, ncol));
+    SEXP names = PROTECT(Rf_allocVector(STRSXP, ncol));
+    for (size_t i = 0; i < ncol; ++i) {
+        SET_VECTOR_ELT(res, i, Rf_allocVector(types[i], n));
+        SET_STRING_ELT(names, i, Rf_mkChar(columns[i]));
+    }
+    Rf_setAttrib(res, R_NamesSymbol, names);
+
+    for (size_t i = 0; i < n; ++i) {
+        auto fun = dt->get(i);
+        static const FunctionStats none;
+        auto& stats = fun->stats() ? *fun->stats() : none;
+        std::stringstream ctx;
+        ctx << fun->context();
+        SET_STRING_ELT(VECTOR_ELT(res, 0), i, Rf_mkChar(ctx.str().c_str()));
+        REAL(VECTOR_ELT(res, 1))[i] = stats.rir2pirTime;
+        REAL(VECTOR_ELT(res, 2))[i] = stats.optTime;
+        REAL(VECTOR_ELT(res, 3))[i] = stats.pir2rirTime;
+        REAL(VECTOR_ELT(res, 4))[i] = stats.llvmTime;
+        size_t size = bytecodeSize(fun->body());
+        for (size_t a = 0; a < fun->nargs(); ++a)
+            if (auto arg = fun->defaultArg(a))
+                size += bytecodeSize(arg);
+        INTEGER(VECTOR_ELT(res, 5))[i] = size;
+        LOGICAL(VECTOR_ELT(res, 6))[i] = fun->body()->nativeCode != nullptr;
+        INTEGER(VECTOR_ELT(res, 7))[i] = fun->invocationCount();
+        INTEGER(VECTOR_ELT(res, 8))[i] = fun->deoptCount();
+        INTEGER(VECTOR_ELT(res, 9))[i] =
+            stats.deoptReasons[DeoptReason::Typecheck];
+        INTEGER(VECTOR_ELT(res, 10))[i] =
+            stats.deoptReasons[DeoptReason::Calltarget];
+        INTEGER(VECTOR_ELT(res, 11))[i] =
+            stats.deoptReasons[DeoptReason::EnvStubMaterialized];
+        INTEGER(VECTOR_ELT(res, 12))[i] =
+            stats.deoptReasons[DeoptReason::DeadBranchReached];
+        LOGICAL(VECTOR_ELT(res, 13))[i] =
+            fun->body()->flags.contains(Code::NativeTierUp);
+        INTEGER(VECTOR_ELT(res, 14))[i] =
+            fun->body()->recentSamples(RuntimeProfiler::epoch());
+        INTEGER(VECTOR_ELT(res, 15))[i] = stats.argmatchUsed;
+        INTEGER(VECTOR_ELT(res, 16))[i] = stats.argmatchWasted;
+        INTEGER(VECTOR_ELT(res, 17))[i] = stats.osrEntries;
+    }
+
+    UNPROTECT(2);
+    return res;
+}
+
 REXPORT SEXP pir_compile(SEXP what, SEXP name, SEXP debugFlags,
                          SEXP debugStyle) {
     if (debugFlags != R_NilValue &&
@@ -355,7 +470,7 @@ REXPORT SEXP pir_compile(SEXP what, SEXP name, SEXP debugFlags,
 }
 
 REXPORT SEXP pir_tests() {
-    PirTests::run();
+    pir::Arena::withCleanup([]() { PirTests::run(); });
     return R_NilValue;
 }
 
@@ -401,7 +516,8 @@ REXPORT SEXP pir_check(SEXP f, SEXP checksSxp, SEXP env) {
     if (!isValidClosureSEXP(f))
         rir_compile(f, env);
     PirCheck check(checkTypes);
-    bool res = check.run(f);
+    bool res = false;
+    pir::Arena::withCleanup([&]() { res = check.run(f); });
     return res ? R_TrueValue : R_FalseValue;
 }
 
@@ -429,6 +545,113 @@ SEXP rirOptDefaultOptsDryrun(SEXP closure, const Context& assumptions,
         return closure;
 }
 
+static Function* pirCompileContinuation(SEXP what, Opcode* pc,
+                                        const std::vector<pir::PirType>& stack,
+                                        const std::string& name,
+                                        const pir::DebugOptions& debug) {
+    pir::Module* m = new pir::Module;
+    pir::StreamLogger logger(debug);
+    logger.title("Compiling continuation of " + name);
+    pir::Compiler cmp(m, logger);
+
+    Function* res = nullptr;
+    cmp.compileContinuation(what, name, pc, stack,
+                            [&](pir::ClosureVersion* c) {
+                                logger.flush();
+                                cmp.optimizeModule();
+                                pir::Pir2RirCompiler p2r(logger);
+                                res = p2r.compile(c, false);
+                                if (pir::Parameter::PIR_ASYNC_COMPILE)
+                                    pir::JitQueue::flush();
+                            },
+                            [&]() {
+                                if (debug.includes(
+                                        pir::DebugFlag::ShowWarnings))
+                                    std::cerr << "Compilation failed\n";
+                            });
+
+    delete m;
+    return res;
+}
+
+// The last continuation compiled for a closure is kept in its baseline code
+// (see Code::osrContinuation) and reused by invocations entering the same loop
+// with the same types on the stack.
+struct OsrContinuationKey {
+    unsigned pcOffset;
+    // Number of times the continuation deopted and was compiled again
+    unsigned recompiled;
+    size_t stackSize;
+    pir::PirType* types() { return (pir::PirType*)(this + 1); }
+
+    static size_t size(size_t stackSize) {
+        return sizeof(OsrContinuationKey) + stackSize * sizeof(pir::PirType);
+    }
+    bool matches(unsigned offset, const std::vector<pir::PirType>& other) {
+        return pcOffset == offset && stackSize == other.size() &&
+               std::equal(other.begin(), other.end(), types());
+    }
+};
+
+// A continuation which keeps deopting is not compiled again, instead the loop
+// stays in the baseline code
+static constexpr unsigned MAX_OSR_RECOMPILES = 1;
+
+Function* rirOptContinuation(SEXP closure, Opcode* pc,
+                             const R_bcstack_t* stack, size_t stackSize,
+                             SEXP name) {
+    std::string n = "";
+    if (TYPEOF(name) == SYMSXP)
+        n = CHAR(PRINTNAME(name));
+    std::vector<pir::PirType> types;
+    for (size_t i = 0; i < stackSize; ++i) {
+        SEXP v = ostack_at_cell(stack + i);
+        // Only plain values can be passed to the continuation
+        if (TYPEOF(v) == PROMSXP || TYPEOF(v) == EXTERNALSXP)
+            return nullptr;
+        // The continuation is only reused for the same types, thus it can
+        // rely on the exact types
+        types.push_back(pir::PirType(v));
+    }
+
+    auto baseline = DispatchTable::unpack(BODY(closure))->baseline()->body();
+    unsigned offset = pc - baseline->code();
+    unsigned recompiled = 0;
+    if (auto cached = baseline->osrContinuation()) {
+        auto key = (OsrContinuationKey*)RAW(VECTOR_ELT(cached, 0));
+        if (key->matches(offset, types)) {
+            auto fun = Function::unpack(VECTOR_ELT(cached, 1));
+            if (fun->deoptCount() == 0)
+                return fun;
+            // Compile it again with the updated feedback
+            if (key->recompiled == MAX_OSR_RECOMPILES)
+                return nullptr;
+            recompiled = key->recompiled + 1;
+        }
+    }
+
+    Function* fun = nullptr;
+    pir::Arena::withCleanup([&]() {
+        fun = pirCompileContinuation(closure, pc, types, n, PirDebug);
+    });
+    if (!fun)
+        return nullptr;
+    Protect p(fun->container());
+    SEXP cached = p(Rf_allocVector(VECSXP, 2));
+    SEXP keyStore =
+        Rf_allocVector(RAWSXP, OsrContinuationKey::size(types.size()));
+    SET_VECTOR_ELT(cached, 0, keyStore);
+    SET_VECTOR_ELT(cached, 1, fun->container());
+    auto key = (OsrContinuationKey*)RAW(keyStore);
+    key->pcOffset = offset;
+    key->recompiled = recompiled;
+    key->stackSize = types.size();
+    for (size_t i = 0; i < types.size(); ++i)
+        new (&key->types()[i]) pir::PirType(types[i]);
+    baseline->osrContinuation(cached);
+    return fun;
+}
+
 REXPORT SEXP rir_serialize(SEXP data, SEXP fileSexp) {
     oldPreserve = pir::Parameter::RIR_PRESERVE;
     pir::Parameter::RIR_PRESERVE = true;
@@ -8,10 +8,16 @@
 
 #define REXPORT extern "C"
 
+namespace rir {
+struct Function;
+enum class Opcode : uint8_t;
+} // namespace rir
+
 extern int R_ENABLE_JIT;
 extern rir::pir::DebugOptions PirDebug;
 
 REXPORT SEXP rir_invocation_count(SEXP what);
+REXPORT SEXP rir_stats(SEXP what);
 REXPORT SEXP rir_eval(SEXP exp, SEXP env);
 REXPORT SEXP pir_compile(SEXP closure, SEXP name, SEXP debugFlags,
                          SEXP debugStyle);
@@ -24,6 +30,9 @@ SEXP pirCompile(SEXP closure, const rir::Context& assumptions,
 extern SEXP rirOptDefaultOpts(SEXP closure, const rir::Context&, SEXP name);
 extern SEXP rirOptDefaultOptsDryrun(SEXP closure, const rir::Context&,
                                     SEXP name);
+extern rir::Function* rirOptContinuation(SEXP closure, rir::Opcode* pc,
+                                         const R_bcstack_t* stack,
+                                         size_t stackSize, SEXP name);
 REXPORT SEXP rir_serialize(SEXP data, SEXP file);
 REXPORT SEXP rir_deserialize(SEXP file);
 
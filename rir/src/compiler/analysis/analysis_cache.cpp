@@ -0,0 +1,57 @@
+#include "analysis_cache.h"
+#include "../pir/pir_impl.h"
+#include "../util/visitor.h"
+
+namespace rir {
+namespace pir {
+
+void AnalysisCache::validate() {
+    std::vector<uintptr_t> current = {code->nextBBId};
+    Visitor::run(code->entry, [&](BB* bb) {
+        auto succ = bb->successors();
+        current.push_back((uintptr_t)bb);
+        current.push_back(bb->id);
+        current.push_back(succ.size());
+        for (auto n : succ)
+            current.push_back((uintptr_t)n);
+    });
+    if (current == shape)
+        return;
+
+    shape = std::move(current);
+    loops_.reset();
+    dfront_.reset();
+    dom_.reset();
+    cfg_.reset();
+}
+
+const CFG& AnalysisCache::cfg() {
+    validate();
+    if (!cfg_)
+        cfg_ = std::make_unique<CFG>(code);
+    return *cfg_;
+}
+
+const DominanceGraph& AnalysisCache::dominanceGraph() {
+    validate();
+    if (!dom_)
+        dom_ = std::make_unique<DominanceGraph>(code);
+    return *dom_;
+}
+
+const DominanceFrontier& AnalysisCache::dominanceFrontier() {
+    auto& dom = dominanceGraph();
+    if (!dfront_)
+        dfront_ = std::make_unique<DominanceFrontier>(code, dom);
+    return *dfront_;
+}
+
+LoopDetection& AnalysisCache::loops() {
+    validate();
+    if (!loops_)
+        loops_ = std::make_unique<LoopDetection>(code);
+    return *loops_;
+}
+
+} // namespace pir
+} // namespace rir
@@ -0,0 +1,47 @@
+#ifndef PIR_ANALYSIS_CACHE_H
+#define PIR_ANALYSIS_CACHE_H
+
+#include "cfg.h"
+#include "loop_detection.h"
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace rir {
+namespace pir {
+
+/*
+ * The analyses of a Code which only depend on its control flow graph. Results
+ * are reused by later passes, until the shape of the graph (the blocks, their
+ * ids and their successors) changes. A pass changing the graph does not need
+ * to invalidate anything, the next lookup recomputes.
+ *
+ * A result must not be used after the pass changed the graph and asked for it
+ * again, since it is replaced then.
+ */
+class AnalysisCache {
+  public:
+    explicit AnalysisCache(Code* code) : code(code) {}
+
+    const CFG& cfg();
+    const DominanceGraph& dominanceGraph();
+    const DominanceFrontier& dominanceFrontier();
+    LoopDetection& loops();
+
+  private:
+    void validate();
+
+    Code* code;
+    std::vector<uintptr_t> shape;
+
+    std::unique_ptr<CFG> cfg_;
+    std::unique_ptr<DominanceGraph> dom_;
+    std::unique_ptr<DominanceFrontier> dfront_;
+    std::unique_ptr<LoopDetection> loops_;
+};
+
+} // namespace pir
+} // namespace rir
+
+#endif
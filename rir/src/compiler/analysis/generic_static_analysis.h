@@ -10,7 +10,9 @@
 #include "abstract_result.h"
 #include "compiler/analysis/cfg.h"
 #include "compiler/log/stream_logger.h"
+#include "utils/Map.h"
 
+#include <algorithm>
 #include <stack>
 #include <unordered_map>
 
@@ -36,6 +38,10 @@ namespace pir {
  * AbstractState basically has to have a merge function.
  * Anything else depends on the requirements of the apply function, which is
  * provided by the subclass that specializes StaticAnalysis.
+ *
+ * All state is indexed by BB id. The fixed-point iteration visits the changed
+ * BBs in reverse postorder (w.r.t. the direction of the analysis), such that
+ * a BB is usually only visited after all of its inputs.
  */
 
 enum class AnalysisDebugLevel {
@@ -69,7 +75,8 @@ class StaticAnalysis {
         bool seen = false;
         size_t incomming = 0;
         AbstractState entry;
-        std::unordered_map<Instruction*, AbstractState> extra;
+        // Usually only a handful per BB
+        SmallMap<Instruction*, AbstractState> extra;
     };
     typedef std::vector<BBSnapshot> AnalysisSnapshots;
     AnalysisSnapshots snapshots;
@@ -83,21 +90,29 @@ class StaticAnalysis {
 
     constexpr static size_t MAX_CACHE_SIZE = 128 / sizeof(AbstractState);
 
-    std::unordered_map<Instruction*, AbstractState> cache;
-    std::deque<Instruction*> cacheQueue;
+    // Ring buffer of the most recently computed states
+    std::vector<std::pair<Instruction*, AbstractState>> cache;
+    size_t cacheNext = 0;
+    const AbstractState* fromCache(Instruction* i) const {
+        for (auto& e : cache)
+            if (e.first == i)
+                return &e.second;
+        return nullptr;
+    }
     void addToCache(Instruction* i, const AbstractState& state) const {
-        if (cache.count(i)) {
-            const_cast<StaticAnalysis*>(this)->cache.erase(cache.find(i));
-            const_cast<StaticAnalysis*>(this)->cache.emplace(i, state);
-            return;
+        auto self = const_cast<StaticAnalysis*>(this);
+        for (auto& e : self->cache) {
+            if (e.first == i) {
+                e.second = state;
+                return;
+            }
         }
-        if (cacheQueue.size() > MAX_CACHE_SIZE) {
-            auto oldest = cacheQueue.front();
-            const_cast<StaticAnalysis*>(this)->cacheQueue.pop_front();
-            const_cast<StaticAnalysis*>(this)->cache.erase(cache.find(oldest));
+        if (cache.size() <= MAX_CACHE_SIZE) {
+            self->cache.emplace_back(i, state);
+            return;
         }
-        const_cast<StaticAnalysis*>(this)->cache.emplace(i, state);
-        const_cast<StaticAnalysis*>(this)->cacheQueue.push_back(i);
+        self->cache[cacheNext] = {i, state};
+        self->cacheNext = (cacheNext + 1) % cache.size();
     }
 
   protected:
@@ -235,8 +250,8 @@ class StaticAnalysis {
 
         BB* bb = i->bb();
 
-        if (cache.count(i)) {
-            auto state = cache.at(i);
+        if (auto cached = fromCache(i)) {
+            auto state = *cached;
             if (PositioningStyle::AfterInstruction == POS)
                 apply(state, i);
             return state;
@@ -303,7 +318,7 @@ class StaticAnalysis {
                     collect(state, i);
 
                 const auto& entry = bbSnapshots.extra.find(i);
-                if (entry != bbSnapshots.extra.end())
+                if (entry != bbSnapshots.extra.cend())
                     state = entry->second;
                 else
                     apply(state, i);
@@ -323,19 +338,23 @@ class StaticAnalysis {
 
         logHeader();
 
+        std::vector<std::vector<BB*>> orders;
+        for (auto e : entrypoints)
+            orders.push_back(reversePostorder(e));
+
         typedef std::pair<BB*, Instruction*> Position;
         std::vector<Position> recursiveTodo;
         do {
             done = true;
-            for (auto e : entrypoints) {
+            for (auto& order : orders) {
                 if (globalState)
                     globalState->resetChanged();
 
-                Visitor::runInDirection(Forward, e, [&](BB* bb) {
+                for (auto bb : order) {
                     size_t id = bb->id;
 
                     if (!changed[id])
-                        return;
+                        continue;
 
                     AbstractState state = snapshots[id].entry;
                     logInitialState(state, bb);
@@ -359,7 +378,7 @@ class StaticAnalysis {
                                 entry->second.merge(state);
                                 state = entry->second;
                             } else {
-                                extra.emplace(i, state);
+                                extra.insert(i, state);
                             }
                             recursiveTodo.push_back(Position(bb, i));
                         }
@@ -393,7 +412,7 @@ class StaticAnalysis {
                         }
 
                         changed[id] = false;
-                        return;
+                        continue;
                     }
 
                     if (Forward)
@@ -404,7 +423,7 @@ class StaticAnalysis {
                             mergeBranch(bb, suc, state, changed);
 
                     changed[id] = false;
-                });
+                }
                 if (!recursiveTodo.empty()) {
                     for (auto& rec : recursiveTodo) {
                         auto bb = rec.first->id;
@@ -418,7 +437,7 @@ class StaticAnalysis {
                                 done = false;
                             }
                         } else {
-                            extra.emplace(rec.second, exitpoint);
+                            extra.insert(rec.second, exitpoint);
                             changed[bb] = true;
                             done = false;
                         }
@@ -478,6 +497,44 @@ class StaticAnalysis {
     }
 
   private:
+    // The BBs reachable from start in the direction of the analysis, in
+    // reverse postorder
+    std::vector<BB*> reversePostorder(BB* start) const {
+        std::vector<BB*> order;
+        std::vector<bool> seen(snapshots.size(), false);
+        auto next = [](BB* bb) {
+            std::vector<BB*> res;
+            if (Forward)
+                for (auto n : bb->successors())
+                    res.push_back(n);
+            else
+                for (auto n : bb->predecessors())
+                    res.push_back(n);
+            return res;
+        };
+
+        // Iterative DFS, each entry is a BB and its unvisited neighbors
+        std::stack<std::pair<BB*, std::vector<BB*>>> todo;
+        seen[start->id] = true;
+        todo.emplace(start, next(start));
+        while (!todo.empty()) {
+            auto& top = todo.top();
+            if (top.second.empty()) {
+                order.push_back(top.first);
+                todo.pop();
+                continue;
+            }
+            auto n = top.second.back();
+            top.second.pop_back();
+            if (!seen[n->id]) {
+                seen[n->id] = true;
+                todo.emplace(n, next(n));
+            }
+        }
+        std::reverse(order.begin(), order.end());
+        return order;
+    }
+
     void seedEntries() {
         if (Forward) {
             entrypoints.push_back(code->entry);
@@ -1,48 +1,92 @@
 #include "liveness.h"
 #include "../pir/bb.h"
 #include "../pir/instruction.h"
-#include "../util/visitor.h"
-#include "compiler/analysis/cfg.h"
+#include "utils/BitVector.h"
+#include "utils/Map.h"
 
-#include <map>
-#include <set>
+#include <stack>
 
 namespace rir {
 namespace pir {
 
+unsigned LivenessIntervals::number(Value* v, unsigned bbsSize) {
+    auto it = index.find(v);
+    if (it != index.end())
+        return it->second;
+    // First time we see this variable, need to allocate vector of all
+    // liveranges
+    unsigned n = values.size();
+    index.emplace(v, n);
+    values.push_back(v);
+    intervals.emplace_back(bbsSize);
+    return n;
+}
+
 LivenessIntervals::LivenessIntervals(Code* code, unsigned bbsSize) {
-    // temp list of live out sets for every BB
-    // ordered set so we can use std::includes
-    std::unordered_map<BB*, std::set<Value*>> liveAtEnd(bbsSize);
+    // BBs are processed in postorder, i.e. usually after their successors.
+    // The worklist is a bit vector of postorder positions.
+    std::vector<BB*> order;
+    std::vector<unsigned> position(bbsSize, (unsigned)-1);
+    auto positionOf = [&](BB* bb) {
+        if (position[bb->id] == (unsigned)-1) {
+            position[bb->id] = order.size();
+            order.push_back(bb);
+        }
+        return position[bb->id];
+    };
+    {
+        std::vector<bool> seen(bbsSize, false);
+        std::stack<std::pair<BB*, size_t>> dfs;
+        seen[code->entry->id] = true;
+        dfs.emplace(code->entry, 0);
+        while (!dfs.empty()) {
+            auto bb = dfs.top().first;
+            auto succ = bb->successors();
+            if (dfs.top().second == succ.size()) {
+                positionOf(bb);
+                dfs.pop();
+                continue;
+            }
+            auto n = succ.begin()[dfs.top().second++];
+            if (!seen[n->id]) {
+                seen[n->id] = true;
+                dfs.emplace(n, 0);
+            }
+        }
+    }
+
+    // temp list of live out sets for every BB, and whether the BB was
+    // reached by the analysis
+    std::vector<BitVector> liveAtEnd(bbsSize);
+    std::vector<bool> reached(bbsSize, false);
 
-    DominanceGraph dom(code);
     // this is a backwards analysis, starting from CFG exits
-    std::unordered_set<BB*> todo;
-    Visitor::run(code->entry, [&](BB* bb) {
+    BitVector todo;
+    for (auto bb : order)
         if (bb->isExit())
-            todo.insert(bb);
-    });
+            todo.set(position[bb->id]);
 
 restart:
     while (!todo.empty()) {
-        BB* bb = *todo.begin();
-        todo.erase(todo.begin());
+        BB* bb = order[todo.first()];
+        todo.reset(position[bb->id]);
+        reached[bb->id] = true;
 
         // keep track of currently live variables
-        // ordered sets so we can use std::includes
-        std::set<Value*> accumulated;
-        std::unordered_map<BB*, std::set<Value*>> accumulatedPhiInput;
+        BitVector accumulated(values.size());
+        size_t accumulatedSize = 0;
+        SmallMap<BB*, BitVector> accumulatedPhiInput;
 
         // Mark all (backwards) incoming live variables
-        for (const auto& v : liveAtEnd[bb]) {
-            assert(count(v));
+        liveAtEnd[bb->id].forEach([&](size_t v) {
             auto& liveRange = intervals[v][bb->id];
             if (!liveRange.live || liveRange.end < bb->size()) {
                 liveRange.live = true;
                 liveRange.end = bb->size();
-                accumulated.insert(v);
+                if (accumulated.set(v))
+                    accumulatedSize++;
             }
-        }
+        });
 
         // Run BB in reverse
         size_t pos = bb->size();
@@ -53,13 +97,7 @@ restart:
                 --pos;
                 Instruction* i = *ip;
 
-                auto markIfNotSeen = [&](Value* v) {
-                    if (!count(v)) {
-                        // First time we see this variable, need to allocate
-                        // vector of all liveranges
-                        intervals[v].resize(bbsSize);
-                        assert(!intervals[v][bb->id].live);
-                    }
+                auto markIfNotSeen = [&](unsigned v) {
                     auto& liveRange = intervals[v][bb->id];
                     if (!liveRange.live) {
                         liveRange.live = true;
@@ -72,28 +110,29 @@ restart:
                 // First set all arguments to be live
                 if (auto phi = Phi::Cast(i)) {
                     phi->eachArg([&](BB* in, Value* v) {
-                        if (markIfNotSeen(v))
-                            accumulatedPhiInput[in].insert(v);
+                        auto n = number(v, bbsSize);
+                        if (markIfNotSeen(n))
+                            accumulatedPhiInput[in].set(n);
                     });
                 } else {
                     i->eachArg([&](Value* v) {
-                        if (markIfNotSeen(v)) {
-                            accumulated.insert(v);
-                        }
+                        auto n = number(v, bbsSize);
+                        if (markIfNotSeen(n) && accumulated.set(n))
+                            accumulatedSize++;
                     });
                 }
 
                 // Mark the end of the current instructions liveness
-                if (accumulated.count(i)) {
-                    assert(count(i));
-                    auto& liveRange = intervals[i][bb->id];
+                auto n = index.find(i);
+                if (n != index.end() && accumulated.reset(n->second)) {
+                    auto& liveRange = intervals[n->second][bb->id];
                     assert(liveRange.live);
                     liveRange.begin = pos;
-                    accumulated.erase(accumulated.find(i));
+                    accumulatedSize--;
                 }
 
-                if (accumulated.size() > maxLive)
-                    maxLive = accumulated.size();
+                if (accumulatedSize > maxLive)
+                    maxLive = accumulatedSize;
 
             } while (ip != bb->begin());
         }
@@ -102,46 +141,36 @@ restart:
         // Mark everything that is live at the beginning of the BB.
         // Note that we need a separate `liveAtEntry` flag; begin = 0 cannot
         // distinguish between liveness before or after the first instruction.
-        auto markLiveEntry = [&](Value* v) {
-            assert(count(v));
+        auto markLiveEntry = [&](size_t v) {
             auto& liveRange = intervals[v][bb->id];
             assert(liveRange.live);
             liveRange.liveAtEntry = true;
             liveRange.begin = 0;
         };
-        for (const auto& v : accumulated)
-            markLiveEntry(v);
+        accumulated.forEach(markLiveEntry);
         for (const auto& pi : accumulatedPhiInput)
-            for (const auto& v : pi.second)
-                markLiveEntry(v);
+            pi.second.forEach(markLiveEntry);
 
         // Merge everything that is live at the beginning of the BB into the
         // incoming vars of all predecessors
         //
         // Phi inputs should only be merged to BB that are successors of the
         // input BBs
-        auto merge = [&](BB* bb, const std::set<Value*>& live) {
-            auto& liveOut = liveAtEnd[bb];
-            if (!std::includes(liveOut.begin(), liveOut.end(), live.begin(),
-                               live.end())) {
-                liveOut.insert(live.begin(), live.end());
-                todo.insert(bb);
-            }
+        auto merge = [&](BB* bb, const BitVector& live) {
+            if (liveAtEnd[bb->id].merge(live))
+                todo.set(positionOf(bb));
         };
         auto mergePhiInp = [&](BB* bb) {
-            for (const auto& in : accumulatedPhiInput) {
-                auto& inBB = in.first;
-                auto& inLive = in.second;
-                if (bb == inBB) {
-                    merge(bb, inLive);
-                }
-            }
+            auto in = accumulatedPhiInput.find(bb);
+            if (in != accumulatedPhiInput.end())
+                merge(bb, in->second);
         };
         for (const auto& pre : bb->predecessors()) {
-            if (!liveAtEnd.count(pre)) {
-                liveAtEnd[pre] = accumulated;
+            if (!reached[pre->id]) {
+                reached[pre->id] = true;
+                liveAtEnd[pre->id] = accumulated;
                 mergePhiInp(pre);
-                todo.insert(pre);
+                todo.set(positionOf(pre));
             } else {
                 merge(pre, accumulated);
                 mergePhiInp(pre);
@@ -151,11 +180,12 @@ restart:
 
     // enqueue nodes that are alive and have a non-live successor
     // to be processed on the next iteration
-    for (auto p : liveAtEnd) {
-        auto bb = p.first;
+    for (auto bb : order) {
+        if (!reached[bb->id])
+            continue;
         for (auto n : bb->successors()) {
-            if (!liveAtEnd.count(n))
-                todo.insert(n);
+            if (!reached[n->id])
+                todo.set(positionOf(n));
         }
     }
 
@@ -163,9 +193,9 @@ restart:
         goto restart;
 
 #ifdef DEBUG_LIVENESS
-    for (const auto& kv : intervals) {
-        const auto& instr = Instruction::Cast(kv.first);
-        const auto& liveVec = kv.second;
+    for (size_t n = 0; n < values.size(); ++n) {
+        const auto& instr = Instruction::Cast(values[n]);
+        const auto& liveVec = intervals[n];
 
         std::cerr << "========== Liveness info for ";
         if (instr) {
@@ -173,7 +203,7 @@ restart:
             instr->print(std::cerr, false);
         } else {
             std::cerr << "non-instr val:\n";
-            kv.first->printRef(std::cerr);
+            values[n]->printRef(std::cerr);
         }
         std::cerr << "\n";
 
@@ -192,7 +222,7 @@ restart:
 bool LivenessIntervals::live(Instruction* where, Value* what) const {
     if (!what->isInstruction() || count(what) == 0)
         return false;
-    const auto& bbLiveness = intervals.at(what)[where->bb()->id];
+    const auto& bbLiveness = at(what)[where->bb()->id];
     if (!bbLiveness.live)
         return false;
     unsigned idx = where->bb()->indexOf(where);
@@ -203,7 +233,7 @@ bool LivenessIntervals::live(const BB::Instrs::iterator& where,
                              Value* what) const {
     if (!what->isInstruction() || count(what) == 0)
         return false;
-    const auto& bbLiveness = intervals.at(what)[(*where)->bb()->id];
+    const auto& bbLiveness = at(what)[(*where)->bb()->id];
     if (!bbLiveness.live)
         return false;
     unsigned idx = where - (*where)->bb()->begin();
@@ -211,8 +241,8 @@ bool LivenessIntervals::live(const BB::Instrs::iterator& where,
 }
 
 bool LivenessIntervals::interfere(Value* v1, Value* v2) const {
-    const auto& l1 = intervals.at(v1);
-    const auto& l2 = intervals.at(v2);
+    const auto& l1 = at(v1);
+    const auto& l2 = at(v2);
     assert(l1.size() == l2.size());
 
     for (size_t i = 0; i < l1.size(); ++i) {
@@ -243,7 +273,7 @@ bool LivenessIntervals::interfere(Value* v1, Value* v2) const {
 bool LivenessIntervals::liveAtBBEntry(BB* bb, Value* what) const {
     if (count(what) == 0)
         return false;
-    const auto& bbLiveness = intervals.at(what)[bb->id];
+    const auto& bbLiveness = at(what)[bb->id];
     return bbLiveness.live && bbLiveness.liveAtEntry;
 }
 
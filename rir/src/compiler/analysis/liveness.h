@@ -17,7 +17,7 @@
  *   3. Because we're in SSA, we don't actually need to compute a fixed point.
  *
  * Liveness intervals are stored as:
- *   Instruction* -> BB id -> { Dead | Live [start, end) }
+ *   Value number -> BB id -> { Dead | Live [start, end) }
  *
  * An instruction maps to a vector, where each entry represents a BB's liveness
  * interval. `start` is included, `end` is excluded. Liveness is for the
@@ -54,7 +54,16 @@ struct BBLiveness {
 };
 
 class LivenessIntervals {
-    std::unordered_map<Value*, std::vector<BBLiveness>> intervals;
+    // Values are numbered densely, in the order they are first seen. The
+    // live sets of the analysis are bit vectors of these numbers.
+    std::unordered_map<Value*, unsigned> index;
+    std::vector<Value*> values;
+    std::vector<std::vector<BBLiveness>> intervals;
+
+    unsigned number(Value* v, unsigned bbsSize);
+    const std::vector<BBLiveness>& at(Value* v) const {
+        return intervals[index.at(v)];
+    }
 
   public:
     LivenessIntervals(Code* code, unsigned bbsSize);
@@ -72,7 +81,7 @@ class LivenessIntervals {
     // Returns true if `what` is live at the beginning of `bb`.
     bool liveAtBBEntry(BB* bb, Value* what) const;
 
-    size_t count(Value* v) const { return intervals.count(v); }
+    size_t count(Value* v) const { return index.count(v); }
     size_t maxLive = 0;
 };
 
@@ -7,6 +7,9 @@
 #include "../pir/pir.h"
 #include "abstract_value.h"
 
+#include <algorithm>
+#include <climits>
+#include <cmath>
 #include <unordered_map>
 #include <unordered_set>
 
@@ -25,13 +28,63 @@ inline int min(int a, int b) {
     return a;
 }
 
-static constexpr int MIN = -20;
-static constexpr int MAX = 20;
+// Bounds of the (non-NA) values. For integers these are the limits of the
+// domain, for doubles they stand for unbounded.
+static constexpr int MIN = -INT_MAX;
+static constexpr int MAX = INT_MAX;
+
+// How often a bound may grow at a merge, before it is widened to MIN / MAX.
+// Ensures termination for loop counters.
+static constexpr unsigned WIDENING_THRESHOLD = 3;
 
 typedef std::pair<int, int> Range;
+
+inline int clampBound(int64_t b) {
+    if (b < MIN)
+        return MIN;
+    if (b > MAX)
+        return MAX;
+    return b;
+}
+
+// Interval arithmetic. With `ints` the bounds are exact, otherwise MIN and MAX
+// are infinite and stay so.
+inline Range addRange(Range a, Range b, bool ints) {
+    return {(!ints && (a.first == MIN || b.first == MIN))
+                ? MIN
+                : clampBound((int64_t)a.first + b.first),
+            (!ints && (a.second == MAX || b.second == MAX))
+                ? MAX
+                : clampBound((int64_t)a.second + b.second)};
+}
+
+inline Range subRange(Range a, Range b, bool ints) {
+    return {(!ints && (a.first == MIN || b.second == MAX))
+                ? MIN
+                : clampBound((int64_t)a.first - b.second),
+            (!ints && (a.second == MAX || b.first == MIN))
+                ? MAX
+                : clampBound((int64_t)a.second - b.first)};
+}
+
+inline Range mulRange(Range a, Range b, bool ints) {
+    if (!ints && (a.first == MIN || a.second == MAX || b.first == MIN ||
+                  b.second == MAX))
+        return {MIN, MAX};
+    int64_t p[] = {(int64_t)a.first * b.first, (int64_t)a.first * b.second,
+                   (int64_t)a.second * b.first, (int64_t)a.second * b.second};
+    return {clampBound(*std::min_element(p, p + 4)),
+            clampBound(*std::max_element(p, p + 4))};
+}
+
 struct RangeAnalysisState {
     std::unordered_map<Value*, Range> range;
+    // How often the bounds of a value grew at merges
+    std::unordered_map<Value*, unsigned> grown;
     std::unordered_set<Phi*> seen;
+    // Blocks analyzed up to their end, values they define have their range
+    // (or none) by now
+    std::unordered_set<BB*> processed;
 
     void print(std::ostream& out, bool tty) const {
         for (auto i : range) {
@@ -44,6 +97,11 @@ struct RangeAnalysisState {
     }
     AbstractResult merge(const RangeAnalysisState& other) {
         AbstractResult res = AbstractResult::None;
+        for (auto& g : other.grown) {
+            auto& mine = grown[g.first];
+            if (mine < g.second)
+                mine = g.second;
+        }
         for (auto o = other.range.begin(); o != other.range.end(); o++) {
             auto m = range.find(o->first);
             if (m == range.end()) {
@@ -52,18 +110,16 @@ struct RangeAnalysisState {
             } else {
                 auto& mine = m->second;
                 auto their = o->second;
-                auto mi = min(mine.first, their.first);
-                if (mi < MIN)
-                    mi = MIN;
-                if (mine.first > mi) {
-                    mine.first = mi;
+                if (their.first < mine.first) {
+                    mine.first = ++grown[o->first] > WIDENING_THRESHOLD
+                                     ? MIN
+                                     : their.first;
                     res.update();
                 }
-                auto ma = max(mine.second, their.second);
-                if (ma > MAX)
-                    ma = MAX;
-                if (mine.second < ma) {
-                    mine.second = ma;
+                if (their.second > mine.second) {
+                    mine.second = ++grown[o->first] > WIDENING_THRESHOLD
+                                      ? MAX
+                                      : their.second;
                     res.update();
                 }
             }
@@ -72,16 +128,27 @@ struct RangeAnalysisState {
             res.update();
             seen.insert(other.seen.begin(), other.seen.end());
         }
+        for (auto bb : other.processed)
+            if (processed.insert(bb).second)
+                res.update();
         return res;
     }
 };
 
+/*
+ * Interval analysis of integer and double values. Conditional branches refine
+ * the ranges of the compared values, e.g. in the loop body of
+ * `while (i < n)` the upper bound of i is the upper bound of n minus one.
+ * Bounds which keep growing in loops are widened.
+ */
 class RangeAnalysis : public StaticAnalysis<RangeAnalysisState, DummyState,
                                             true, AnalysisDebugLevel::None> {
   public:
     RangeAnalysis(ClosureVersion* cls, Code* code, LogStream& log)
         : StaticAnalysis("Range", cls, code, log) {}
 
+    static bool isInt(Value* v) { return v->type.isA(RType::integer); }
+
     AbstractResult apply(RangeAnalysisState& state,
                          Instruction* i) const override {
         AbstractResult res = AbstractResult::None;
@@ -98,149 +165,98 @@ class RangeAnalysis : public StaticAnalysis<RangeAnalysisState, DummyState,
             if (!br)
                 return;
 
-            auto t = AsTest::Cast(br->arg(0).val());
-            if (!t)
-                return;
-
-            Instruction* condition = Instruction::Cast(t->arg(0).val());
+            // Without AsTest an NA condition takes the false branch
+            bool maybeNA = true;
+            Value* cond = br->arg(0).val();
+            if (auto t = AsTest::Cast(cond)) {
+                cond = t->arg(0).val();
+                maybeNA = false;
+            }
+            Instruction* condition = Instruction::Cast(cond);
             if (!condition)
                 return;
 
-            bool holds = i->bb() == pred->trueBranch();
+            bool takenTrue = i->bb() == pred->trueBranch();
+            bool holds = takenTrue;
             if (auto n = Not::Cast(condition)) {
-                holds = false;
+                holds = !holds;
                 condition = Instruction::Cast(n->arg(0).val());
             }
-            if (!condition)
+            if (!condition || condition->nargs() < 2 ||
+                condition->effects.contains(Effect::ExecuteCode))
                 return;
 
-            auto applyCond =
-                [&](std::function<Range(int, int, int, int)> getLhs,
-                    std::function<Range(int, int, int, int)> getRhs) {
-                    if (condition->effects.contains(Effect::ExecuteCode))
-                        return;
-                    auto lhs = condition->arg(0).val();
-                    auto rhs = condition->arg(1).val();
-                    if (!holds) {
-                        auto t = lhs;
-                        lhs = rhs;
-                        rhs = t;
-                    }
-
-                    bool hasA = state.range.count(lhs);
-                    bool hasB = state.range.count(rhs);
-
-                    if (!hasA && !hasB)
-                        return;
-
-                    Range& a = state.range[lhs];
-                    Range& b = state.range[rhs];
-                    if (!hasA)
-                        a = Range(MIN, MAX);
-                    if (!hasB)
-                        b = Range(MIN, MAX);
-
-                    auto i1 = a.first;
-                    auto i2 = a.second;
-                    auto i3 = b.first;
-                    auto i4 = b.second;
-                    auto lhsApp = getLhs(i1, i2, i3, i4);
-                    auto rhsApp = getRhs(i1, i2, i3, i4);
-                    auto& lhsCur = state.range[lhs];
-                    auto& rhsCur = state.range[rhs];
-                    if (lhsApp.first > lhsCur.first) {
-                        res.update();
-                        lhsCur.first = lhsApp.first;
-                    }
-                    if (lhsApp.second < lhsCur.second) {
-                        res.update();
-                        lhsCur.second = lhsApp.second;
-                    }
-                    if (rhsApp.first > rhsCur.first) {
-                        res.update();
-                        rhsCur.first = rhsApp.first;
-                    }
-                    if (rhsApp.second < rhsCur.second) {
-                        res.update();
-                        rhsCur.second = rhsApp.second;
-                    }
-                };
+            auto lhs = condition->arg(0).val();
+            auto rhs = condition->arg(1).val();
+            // For vectors only the first element is tested
+            if (!lhs->type.isScalar() || !rhs->type.isScalar())
+                return;
+            if (maybeNA && !takenTrue &&
+                (lhs->type.maybeNAOrNaN() || rhs->type.maybeNAOrNaN()))
+                return;
+            bool ints = isInt(lhs) && isInt(rhs);
+
+            // Refine to l < r, or l <= r if not strict
+            auto less = [&](Value* l, Value* r, bool strict) {
+                if (!state.range.count(l) && !state.range.count(r))
+                    return;
+                if (!state.range.count(l))
+                    state.range[l] = Range(MIN, MAX);
+                if (!state.range.count(r))
+                    state.range[r] = Range(MIN, MAX);
+                auto& a = state.range.at(l);
+                auto& b = state.range.at(r);
+                int adjust = strict && ints ? 1 : 0;
+                auto upper = (!ints && b.second == MAX)
+                                 ? MAX
+                                 : clampBound((int64_t)b.second - adjust);
+                auto lower = (!ints && a.first == MIN)
+                                 ? MIN
+                                 : clampBound((int64_t)a.first + adjust);
+                if (upper < a.second) {
+                    a.second = upper;
+                    res.update();
+                }
+                if (lower > b.first) {
+                    b.first = lower;
+                    res.update();
+                }
+            };
 
             switch (condition->tag) {
-            case Tag::Lte:
             case Tag::Lt:
-                // [a,b] < [c,d] ==> [min(a,d), min(b,d)] [max(a,c), max(a, d)]
-                applyCond(
-                    [&](int a, int b, int c, int d) {
-                        auto bound = d;
-                        // The lower bound a in [a,b] represents all doubles in
-                        // the interval [a, a+1), therefore in most cases we
-                        // cannot be more precise for Lt than for Lte. But if
-                        // the interval is the singleton [n,n], then we know
-                        // that the lower bound is exactly n.
-                        // same bellow for the other cases.
-                        if (condition->tag == Tag::Lt && c == d)
-                            bound--;
-                        return Range(min(a, bound), min(b, bound));
-                    },
-                    [&](int a, int b, int c, int d) {
-                        auto bound = a;
-                        if (condition->tag == Tag::Lte && a == b)
-                            bound++;
-                        return Range(max(bound, c), max(bound, d));
-                    });
+                holds ? less(lhs, rhs, true) : less(rhs, lhs, false);
+                break;
+            case Tag::Lte:
+                holds ? less(lhs, rhs, false) : less(rhs, lhs, true);
                 break;
-
-            case Tag::Gte:
             case Tag::Gt:
-                // [a,b] > [c,d] ==> [max(a,c), max(b,c)] [min(b,c), min(b, d)]
-                applyCond(
-                    [&](int a, int b, int c, int d) {
-                        auto bound = c;
-                        if (condition->tag == Tag::Gt && c == d)
-                            bound++;
-                        return Range(max(a, bound), max(b, bound));
-                    },
-                    [&](int a, int b, int c, int d) {
-                        auto bound = b;
-                        if (condition->tag == Tag::Gte && c == d)
-                            bound--;
-                        return Range(min(bound, c), min(bound, d));
-                    });
+                holds ? less(rhs, lhs, true) : less(lhs, rhs, false);
+                break;
+            case Tag::Gte:
+                holds ? less(rhs, lhs, false) : less(lhs, rhs, true);
                 break;
             default: {}
             }
         };
         branching();
 
-        auto binop = [&](const std::function<int(int, int)> apply) {
+        auto set = [&](const Range& r) {
+            auto& cur = state.range[i];
+            if (cur != r) {
+                cur = r;
+                res.update();
+            }
+        };
+
+        auto binop = [&](Range (*op)(Range, Range, bool)) {
             if (i->effects.contains(Effect::ExecuteCode))
                 return;
-            if (state.range.count(i->arg(0).val()) &&
-                state.range.count(i->arg(1).val())) {
-                auto a = state.range.at(i->arg(0).val());
-                auto b = state.range.at(i->arg(1).val());
-
-                auto up =
-                    Range(apply(a.first, b.first), apply(a.second, b.second));
-
-                if (up.first < MIN)
-                    up.first = MIN;
-
-                if (up.second > MAX)
-                    up.second = MAX;
-
-                auto& cur = state.range[i];
-                if (a.first > MIN && b.first > MIN && cur.first != up.first) {
-                    cur.first = up.first;
-                    res.update();
-                }
-                if (a.second < MAX && b.second < MAX &&
-                    cur.second != up.second) {
-                    cur.second = up.second;
-                    res.update();
-                }
-            }
+            auto a = i->arg(0).val();
+            auto b = i->arg(1).val();
+            if (state.range.count(a) && state.range.count(b))
+                set(op(state.range.at(a), state.range.at(b),
+                       isInt(a) && isInt(b)));
         };
 
         switch (i->tag) {
@@ -248,40 +264,57 @@ class RangeAnalysis : public StaticAnalysis<RangeAnalysisState, DummyState,
             auto ld = LdConst::Cast(i);
             if (IS_SIMPLE_SCALAR(ld->c(), INTSXP)) {
                 auto r = INTEGER(ld->c())[0];
-                state.range[i] = {r, r};
+                if (r != NA_INTEGER)
+                    state.range[i] = {r, r};
             } else if (IS_SIMPLE_SCALAR(ld->c(), REALSXP)) {
                 auto r = REAL(ld->c())[0];
-                state.range[i] = {floor(r), ceil(r)};
+                if (!ISNAN(r))
+                    state.range[i] = {r <= MIN ? MIN : (int)floor(r),
+                                      r >= MAX ? MAX : (int)ceil(r)};
             }
             break;
         }
 
         case Tag::Add:
-            binop([&](int a, int b) { return a + b; });
+            binop(addRange);
             break;
         case Tag::Sub:
-            binop([&](int a, int b) { return a - b; });
+            binop(subRange);
             break;
         case Tag::Mul:
-            binop([&](int a, int b) { return a * b; });
+            binop(mulRange);
+            break;
+        case Tag::Inc: {
+            auto a = i->arg(0).val();
+            if (state.range.count(a))
+                set(addRange(state.range.at(a), {1, 1}, true));
+            break;
+        }
+        case Tag::XLength:
+        case Tag::ForSeqSize:
+            set({0, MAX});
             break;
         case Tag::Phi: {
             int mi = MAX;
             int ma = MIN;
             auto p = Phi::Cast(i);
             p->eachArg([&](BB*, Value* v) {
+                auto def = Instruction::Cast(v);
                 if (state.range.count(v)) {
                     auto r = state.range.at(v);
                     if (r.first < mi)
                         mi = r.first;
                     if (r.second > ma)
                         ma = r.second;
-                } else {
-                    if (state.seen.count(p))
-                        state.range.emplace(v, Range(MIN, MAX));
+                } else if (!def || state.processed.count(def->bb())) {
+                    // A value without range, the phi is unbounded
+                    mi = MIN;
+                    ma = MAX;
                 }
+                // Otherwise a loop carried value, which is not analyzed yet
             });
-            state.range[i] = {mi, ma};
+            if (mi <= ma)
+                state.range[i] = {mi, ma};
             if (!state.seen.count(p)) {
                 res.update();
                 state.seen.insert(p);
@@ -292,6 +325,9 @@ class RangeAnalysis : public StaticAnalysis<RangeAnalysisState, DummyState,
         default: {}
         }
 
+        if (i == i->bb()->last())
+            state.processed.insert(i->bb());
+
         return res;
     }
 };
@@ -9,11 +9,14 @@
 #include "compiler/opt/pass_definitions.h"
 #include "compiler/opt/pass_scheduler.h"
 #include "compiler/parameter.h"
+#include "compiler/util/thread_pool.h"
 
 #include "ir/BC.h"
 #include "ir/Compiler.h"
 
+#include <atomic>
 #include <chrono>
+#include <mutex>
 
 namespace rir {
 namespace pir {
@@ -81,15 +84,13 @@ void Compiler::compileClosure(Closure* closure, rir::Function* optFunction,
         }
     }
 
-    // Currently dots args are not supported in PIR. Unless if we statically
-    // matched all arguments correctly and are therefore guaranteed to receive a
-    // `...` list as DOTSXP in the correct location, we can support them.
-    // TODO: extend call instruction to do the necessary argument shuffling to
-    // support it in all cases
+    // Closures with dots args are compiled for matched arguments only, such
+    // that they receive a `...` list as DOTSXP in the correct location.
+    // Callers which cannot match statically are matched by the interpreter at
+    // runtime (see dotsArgmatchedCall).
     if (!ctx.includes(Assumption::StaticallyArgmatched) &&
         closure->formals().hasDots()) {
-        closure->rirFunction()->flags.set(Function::NotOptimizable);
-        logger.warn("no support for ...");
+        logger.warn("... needs matched arguments");
         return fail();
     }
 
@@ -200,47 +201,132 @@ void Compiler::compileClosure(Closure* closure, rir::Function* optFunction,
     return fail();
 }
 
+void Compiler::compileContinuation(SEXP closure, const std::string& name,
+                                   Opcode* pc,
+                                   const std::vector<PirType>& stack,
+                                   MaybeCls success, Maybe fail) {
+    assert(isValidClosureSEXP(closure));
+
+    auto fun = DispatchTable::unpack(BODY(closure))->baseline();
+    if (fun->body()->codeSize > Parameter::MAX_INPUT_SIZE) {
+        logger.warn("skipping huge function");
+        return fail();
+    }
+
+    // The continuation is only run once, therefore it is not bound to the
+    // closure, but treated like an inner function
+    static SEXP srcRefSymbol = Rf_install("srcref");
+    auto pirClosure = module->getOrDeclareRirFunction(
+        name, fun, FORMALS(closure), Rf_getAttrib(closure, srcRefSymbol));
+    auto version = pirClosure->declareVersion(defaultContext, fun);
+    Builder builder(version);
+    auto& log = logger.begin(version);
+    Rir2Pir rir2pir(*this, version, log, pirClosure->name(), {});
+
+    if (rir2pir.tryCompileContinuation(builder, pc, stack)) {
+        log.compilationEarlyPir(version);
+#ifdef FULLVERIFIER
+        Verify::apply(version, "Error after initial translation", true);
+#else
+#ifndef NDEBUG
+        Verify::apply(version, "Error after initial translation");
+#endif
+#endif
+        log.flush();
+        return success(version);
+    }
+
+    log.failed("rir2pir aborted");
+    log.flush();
+    logger.close(version);
+    pirClosure->erase(defaultContext);
+    return fail();
+}
+
 bool MEASURE_COMPILER_PERF = getenv("PIR_MEASURE_COMPILER") ? true : false;
 std::chrono::time_point<std::chrono::high_resolution_clock> startTime;
 std::chrono::time_point<std::chrono::high_resolution_clock> endTime;
 std::unique_ptr<CompilerPerf> PERF = std::unique_ptr<CompilerPerf>(
     MEASURE_COMPILER_PERF ? new CompilerPerf : nullptr);
 
+size_t Parameter::PIR_OPT_THREADS =
+    getenv("PIR_OPT_THREADS") ? atoi(getenv("PIR_OPT_THREADS")) : 1;
+
+// The calling thread takes part in the work, thus one less worker is needed
+static ThreadPool& optimizationThreads() {
+    static ThreadPool pool(Parameter::PIR_OPT_THREADS - 1);
+    return pool;
+}
+
 void Compiler::optimizeModule() {
     logger.flush();
     size_t passnr = 0;
+    std::mutex perfLock;
     PassScheduler::instance().run([&](const Pass* translation) {
-        bool changed = false;
-        module->eachPirClosure([&](Closure* c) {
-            c->eachVersion([&](ClosureVersion* v) {
-                auto log = logger.get(v).forPass(passnr);
-                log.pirOptimizationsHeader(translation);
-
-                if (MEASURE_COMPILER_PERF)
-                    startTime = std::chrono::high_resolution_clock::now();
-
-                if (translation->apply(*this, v, log.out()))
-                    changed = true;
-                if (MEASURE_COMPILER_PERF) {
-                    endTime = std::chrono::high_resolution_clock::now();
-                    std::chrono::duration<double> passDuration =
-                        endTime - startTime;
-                    PERF->addTime(translation->getName(), passDuration.count());
-                }
+        auto applyPass = [&](ClosureVersion* v, PassStreamLogger& log) {
+            std::chrono::time_point<std::chrono::high_resolution_clock> start;
+            if (MEASURE_COMPILER_PERF)
+                start = std::chrono::high_resolution_clock::now();
+
+            bool changed = translation->apply(*this, v, log.out());
+
+            if (MEASURE_COMPILER_PERF) {
+                std::chrono::duration<double> passDuration =
+                    std::chrono::high_resolution_clock::now() - start;
+                std::lock_guard<std::mutex> guard(perfLock);
+                PERF->addTime(translation->getName(), passDuration.count());
+            }
+            return changed;
+        };
 
-                log.pirOptimizations(translation);
-                log.flush();
+        auto finishPass = [&](ClosureVersion* v, PassStreamLogger& log) {
+            log.pirOptimizations(translation);
+            log.flush();
 
 #ifdef FULLVERIFIER
-                Verify::apply(v, "Error after pass " + translation->getName(),
-                              true);
+            Verify::apply(v, "Error after pass " + translation->getName(),
+                          true);
 #else
 #ifdef ENABLE_SLOWASSERT
-                Verify::apply(v, "Error after pass " + translation->getName());
+            Verify::apply(v, "Error after pass " + translation->getName());
 #endif
 #endif
+        };
+
+        bool changed = false;
+        if (Parameter::PIR_OPT_THREADS > 1 && translation->isThreadSafe()) {
+            // The versions are independent, only the pass itself runs on the
+            // worker threads. Logging and verification stay on this thread.
+            std::vector<ClosureVersion*> versions;
+            std::vector<PassStreamLogger> logs;
+            module->eachPirClosure([&](Closure* c) {
+                c->eachVersion([&](ClosureVersion* v) {
+                    versions.push_back(v);
+                    logs.push_back(logger.get(v).forPass(passnr));
+                    logs.back().pirOptimizationsHeader(translation);
+                });
             });
-        });
+
+            std::atomic<bool> anyChanged(false);
+            optimizationThreads().parallelFor(versions.size(), [&](size_t i) {
+                if (applyPass(versions[i], logs[i]))
+                    anyChanged = true;
+            });
+            changed = anyChanged;
+
+            for (size_t i = 0; i < versions.size(); ++i)
+                finishPass(versions[i], logs[i]);
+        } else {
+            module->eachPirClosure([&](Closure* c) {
+                c->eachVersion([&](ClosureVersion* v) {
+                    auto log = logger.get(v).forPass(passnr);
+                    log.pirOptimizationsHeader(translation);
+                    if (applyPass(v, log))
+                        changed = true;
+                    finishPass(v, log);
+                });
+            });
+        }
         passnr++;
         return changed;
     });
@@ -8,9 +8,11 @@
 
 #include <list>
 #include <stack>
+#include <vector>
 
 namespace rir {
 struct DispatchTable;
+enum class Opcode : uint8_t;
 namespace pir {
 
 class Compiler {
@@ -36,6 +38,13 @@ class Compiler {
                          SEXP formals, SEXP srcRef, const Context& ctx,
                          MaybeCls success, Maybe fail,
                          std::list<PirTypeFeedback*> outerFeedback);
+    // Compiles the rest of an invocation of closure which is interrupted at
+    // pc, with the given types of the values on the operand stack. The
+    // continuation expects these values as arguments and the environment of
+    // the invocation as its closure environment.
+    void compileContinuation(SEXP closure, const std::string& name, Opcode* pc,
+                             const std::vector<PirType>& stack,
+                             MaybeCls success, Maybe fail);
     void optimizeModule();
 
     bool seenC = false;
@@ -1,4 +1,5 @@
 #include "builtins.h"
+#include "vector_kernels.h"
 
 #include "compiler/parameter.h"
 #include "interpreter/ArgsLazyData.h"
@@ -307,7 +308,7 @@ SEXP chkfunImpl(SEXP sym, SEXP res) {
 }
 
 SEXP ldfunImpl(SEXP sym, SEXP env) {
-    SEXP res = Rf_findFun(sym, env);
+    SEXP res = cachedFindFun(sym, env);
 
     // TODO something should happen here
     if (res == R_UnboundValue)
@@ -749,7 +750,13 @@ NativeBuiltin NativeBuiltins::notOp = {"not", (void*)&notImpl};
 
 static SEXP binopEnvImpl(SEXP lhs, SEXP rhs, SEXP env, Immediate srcIdx,
                          BinopKind kind) {
-    SEXP res = nullptr;
+    SEXP res = tryVectorBinop(src_pool_at(globalContext(), srcIdx), lhs, rhs,
+                              kind);
+    if (res) {
+        R_Visible = (Rboolean) true;
+        return res;
+    }
+
     SEXP arglist2 = CONS_NR(rhs, R_NilValue);
     SEXP arglist = CONS_NR(lhs, arglist2);
     SEXP call = src_pool_at(globalContext(), srcIdx);
@@ -817,7 +824,11 @@ NativeBuiltin NativeBuiltins::binopEnv = {
 
 bool debugBinopImpl = false;
 static SEXP binopImpl(SEXP lhs, SEXP rhs, BinopKind kind) {
-    SEXP res = nullptr;
+    SEXP res = tryVectorBinop(R_NilValue, lhs, rhs, kind);
+    if (res) {
+        R_Visible = (Rboolean) true;
+        return res;
+    }
 
     SEXP arglist;
     FAKE_ARGS2(arglist, lhs, rhs);
@@ -939,6 +950,55 @@ NativeBuiltin NativeBuiltins::binop = {
     (void*)&binopImpl,
 };
 
+static SEXP vectorExprImpl(const int* ops, size_t length, Immediate srcIdx,
+                           size_t nargs) {
+    auto ctx = globalContext();
+    std::vector<SEXP> args(nargs);
+    for (size_t i = 0; i < nargs; ++i)
+        args[i] = ostack_at(ctx, nargs - 1 - i);
+
+    SEXP res = tryVectorExpr(src_pool_at(ctx, srcIdx), ops, length,
+                             args.data(), nargs);
+    if (!res) {
+        // Evaluate the tree node by node, intermediate results are kept alive
+        // on the stack
+        std::vector<SEXP> stack;
+        size_t arg = 0;
+        size_t pushed = 0;
+        for (size_t i = 0; i < length; ++i) {
+            if (ops[i] == VectorExprArg) {
+                stack.push_back(args[arg++]);
+                continue;
+            }
+            SEXP rhs = stack.back();
+            stack.pop_back();
+            SEXP lhs = stack.back();
+            stack.pop_back();
+            res = binopImpl(lhs, rhs, (BinopKind)ops[i]);
+            ostack_push(ctx, res);
+            pushed++;
+            stack.push_back(res);
+        }
+        ostack_popn(ctx, pushed);
+    }
+    R_Visible = (Rboolean) true;
+    return res;
+}
+
+NativeBuiltin NativeBuiltins::vectorExpr = {
+    "vectorExpr",
+    (void*)&vectorExprImpl,
+};
+
+static SEXP math1Impl(SEXP x, Math1Kind kind, Immediate srcIdx) {
+    return tryVectorMath1(src_pool_at(globalContext(), srcIdx), x, kind);
+}
+
+NativeBuiltin NativeBuiltins::math1 = {
+    "math1",
+    (void*)&math1Impl,
+};
+
 SEXP colonImpl(int from, int to) {
     if (from != NA_INTEGER && to != NA_INTEGER) {
         return seq_int(from, to);
@@ -1015,6 +1075,7 @@ NativeBuiltin NativeBuiltins::length = {
     "length", (void*)&lengthImpl, nullptr, {llvm::Attribute::ReadOnly}};
 
 void deoptImpl(Code* c, SEXP cls, DeoptMetadata* m, R_bcstack_t* args) {
+    registerDeoptReason(c, cls);
     if (!pir::Parameter::DEOPT_CHAOS) {
         if (cls) {
             // TODO: this version is still reachable from static call inline
@@ -1032,6 +1093,7 @@ void deoptImpl(Code* c, SEXP cls, DeoptMetadata* m, R_bcstack_t* args) {
             // deoptimize properly.
             // TODO: find a way to always know the closure in native code!
             c->nativeCode = nullptr;
+            c->nativeCodeUnboxed = nullptr;
         }
     }
     assert(m->numFrames >= 1);
@@ -1453,6 +1515,8 @@ static SEXP nativeCallTrampolineImpl(SEXP callee, Immediate target,
             return callImplCached(call, target);
         }
     }
+    TierUpNative(fun);
+    fun->body()->directCalls = DirectCallBudget(dt, fun);
 
     auto t = R_BCNodeStackTop;
 
@@ -50,6 +50,17 @@ enum class UnopKind : int {
     PLUS,
 };
 
+enum class Math1Kind : int {
+    SQRT,
+    EXP,
+    FLOOR,
+    CEILING,
+    SIN,
+    COS,
+    LOG2,
+    LOG10,
+};
+
 struct NativeBuiltins {
 
     static NativeBuiltin forcePromise;
@@ -105,6 +116,8 @@ struct NativeBuiltins {
     static NativeBuiltin notEnv;
     static NativeBuiltin binop;
     static NativeBuiltin binopEnv;
+    static NativeBuiltin vectorExpr;
+    static NativeBuiltin math1;
     static NativeBuiltin unop;
     static NativeBuiltin unopEnv;
 
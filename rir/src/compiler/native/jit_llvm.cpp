@@ -1,6 +1,9 @@
 #include "jit_llvm.h"
 
 #include "compiler/parameter.h"
+#include "perf_map.h"
+#include "runtime/Code.h"
+#include "runtime/PirTypeFeedback.h"
 #include "types_llvm.h"
 
 #include <llvm/ADT/STLExtras.h>
@@ -23,6 +26,7 @@
 #include <llvm/IR/LegacyPassManager.h>
 #include <llvm/IR/Mangler.h>
 #include <llvm/IR/Verifier.h>
+#include <llvm/Object/SymbolSize.h>
 #include <llvm/Support/DynamicLibrary.h>
 #include <llvm/Support/Error.h>
 #include <llvm/Support/TargetSelect.h>
@@ -34,6 +38,7 @@
 #include <llvm/Transforms/Scalar/GVN.h>
 #include <llvm/Transforms/Scalar/InductiveRangeCheckElimination.h>
 #include <llvm/Transforms/Utils.h>
+#include <llvm/Transforms/Utils/Cloning.h>
 #include <llvm/Transforms/Vectorize.h>
 
 // analysis passes
@@ -52,8 +57,13 @@
 
 #include <llvm/Transforms/IPO.h>
 #include <unordered_map>
+#include <unordered_set>
 
+#include <atomic>
+#include <condition_variable>
 #include <iostream>
+#include <mutex>
+#include <thread>
 
 namespace {
 
@@ -82,6 +92,66 @@ class JitLLVMImplementation {
 
     orc::VModuleKey moduleKey;
 
+    // Optimization level for the module currently being compiled
+    unsigned optLevel = 0;
+
+    // Names of the functions of the current module for perf, keyed by symbol,
+    // and the symbols of the module being compiled, see PIR_PERF_MAP
+    std::unordered_map<std::string, std::string> perfNames;
+    std::vector<rir::pir::PerfMap::Symbol> perfSymbols;
+
+    // Unoptimized copies of modules compiled in the fast tier, see
+    // PIR_LLVM_TIER_UP. Keyed by the uid of the code object, since the code
+    // might be collected (and its address reused) before it gets hot.
+    struct TierUpCandidate {
+        std::unique_ptr<llvm::Module> module;
+        std::string name;
+        decltype(builtins_) builtins;
+        decltype(perfNames) perfNames;
+    };
+    std::unordered_map<rir::UUID, TierUpCandidate> tierUpCandidates;
+
+    // The modules holding the native code of a code object, see attach. Once
+    // it is collected they are queued in deadModules, and removed from the
+    // layers (which releases their machine code) before the next module.
+    std::unordered_map<rir::UUID, std::vector<VModuleKey>> codeModules;
+    std::vector<VModuleKey> deadModules;
+    // Number of live code objects per module, modules in the cache are shared
+    std::unordered_map<VModuleKey, size_t> moduleUsers;
+
+    // Native code keyed by the final PIR it was lowered from, see
+    // PIR_NATIVE_CACHE. Entries are dropped together with their module.
+    struct CachedCode {
+        VModuleKey module;
+        rir::pir::JitLLVM::Compiled code;
+    };
+    std::unordered_map<std::string, CachedCode> codeCache;
+
+    // Background compilation, see jit_queue.h. A job holds the modules
+    // lowered by one compilation, the worker compiles them in order.
+    struct QueuedModule {
+        llvm::Module* module;
+        std::string name;
+        unsigned optLevel;
+        decltype(builtins_) builtins;
+        decltype(perfNames) perfNames;
+        rir::pir::JitQueue::Installer install;
+        void* result = nullptr;
+        VModuleKey key = -1;
+    };
+    struct Job {
+        std::vector<QueuedModule> modules;
+        bool done = false;
+    };
+    std::mutex jobMutex;
+    std::condition_variable jobCond;
+    std::unique_ptr<Job> job;
+    std::atomic<bool> jobFinished{false};
+    // Modules lowered since the last flush
+    std::vector<QueuedModule> pending;
+    std::thread workerThread;
+    bool stopWorker = false;
+
   public:
     llvm::Module* module = nullptr;
     JitLLVMImplementation()
@@ -99,6 +169,11 @@ class JitLLVMImplementation {
                           return LegacyRTDyldObjectLinkingLayer::Resources{
                               std::make_shared<SectionMemoryManager>(),
                               Resolver};
+                      },
+                      [this](VModuleKey, const object::ObjectFile& obj,
+                             const RuntimeDyld::LoadedObjectInfo& info) {
+                          if (rir::pir::PerfMap::enabled())
+                              recordSymbols(obj, info);
                       }),
           CompileLayer(ObjectLayer, SimpleCompiler(*TM)),
           OptimizeLayer(CompileLayer,
@@ -111,13 +186,33 @@ class JitLLVMImplementation {
         TM->setFastISel(true);
     }
 
+    ~JitLLVMImplementation() {
+        // Don't tear down the layers under the feet of the worker. It
+        // finishes the job in flight and exits, the result is not installed
+        // anymore, we are shutting down.
+        if (workerThread.joinable()) {
+            {
+                std::lock_guard<std::mutex> guard(jobMutex);
+                stopWorker = true;
+            }
+            jobCond.notify_all();
+            workerThread.join();
+        }
+    }
+
     std::unordered_map<rir::pir::ClosureVersion*, llvm::Function*> funs;
     void createModule() {
+        // The worker might still be using the shared LLVM context
+        waitForWorker();
+        removeDeadModules();
+        // Left over if lowering failed
+        delete module;
         module = new llvm::Module("", C);
         module->setDataLayout(TM->createDataLayout());
         moduleKey = -1;
         funs.clear();
         builtins_.clear();
+        perfNames.clear();
     }
 
     llvm::Function* declareFunction(rir::pir::ClosureVersion* v,
@@ -157,24 +252,253 @@ class JitLLVMImplementation {
         return nullptr;
     }
 
-    void* tryCompile(llvm::Function* fun) {
+    void* tryCompile(llvm::Function* fun, rir::Code* tierUpTarget) {
         auto name = fun->getName().str();
 
         verifyFunction(*fun);
-        moduleKey = ES.allocateVModule();
-        cantFail(OptimizeLayer.addModule(
-            moduleKey, std::unique_ptr<llvm::Module>(module)));
-        module = nullptr;
-        auto res = findSymbol(name);
-        auto adr = res.getAddress();
-        // cantFail(OptimizeLayer.removeModule(K));
-        if (adr) {
-            assert(*adr);
-            return (void*)*adr;
+        auto level = initialOptLevel(name, tierUpTarget);
+        auto res = compileCurrentModule(name, level);
+        if (!res && tierUpTarget) {
+            tierUpTarget->flags.reset(rir::Code::NativeTierUp);
+            tierUpCandidates.erase(tierUpTarget->uid);
         }
+        return res;
+    }
+
+    void tryCompileAsync(llvm::Function* fun,
+                         const rir::pir::JitQueue::Installer& install,
+                         rir::Code* tierUpTarget) {
+        auto name = fun->getName().str();
+
+        verifyFunction(*fun);
+        queue(name, initialOptLevel(name, tierUpTarget), install);
+    }
+
+    void tierUp(rir::Code* c) {
+        // Try again on a later call
+        if (busy())
+            return;
+
+        c->flags.reset(rir::Code::NativeTierUp);
+        auto candidate = tierUpCandidates.find(c->uid);
+        if (candidate == tierUpCandidates.end())
+            return;
+        auto name = candidate->second.name;
+        module = candidate->second.module.release();
+        moduleKey = -1;
+        funs.clear();
+        builtins_ = std::move(candidate->second.builtins);
+        perfNames = std::move(candidate->second.perfNames);
+        tierUpCandidates.erase(candidate);
+
+        auto level = rir::pir::Parameter::PIR_LLVM_OPT_LEVEL;
+        if (rir::pir::Parameter::PIR_ASYNC_COMPILE) {
+            R_PreserveObject(c->container());
+            queue(name, level, [this, c, name](void* n) {
+                attach(c);
+                if (n)
+                    installTierUp(c, name, n);
+                R_ReleaseObject(c->container());
+            });
+            flush();
+        } else {
+            auto n = compileCurrentModule(name, level);
+            attach(c);
+            if (n)
+                installTierUp(c, name, n);
+        }
+    }
+
+    void attach(rir::Code* c) {
+        assert(moduleKey != (VModuleKey)-1);
+        attach(c, moduleKey);
+    }
+
+    void attach(rir::Code* c, VModuleKey k) {
+        auto& modules = codeModules[c->uid];
+        if (modules.empty()) {
+            auto handle = R_MakeExternalPtr(new rir::UUID(c->uid), R_NilValue,
+                                            R_NilValue);
+            PROTECT(handle);
+            R_RegisterCFinalizerEx(handle, &finalizeNativeCode, FALSE);
+            c->nativeCodeHandle(handle);
+            UNPROTECT(1);
+        }
+        modules.push_back(k);
+        moduleUsers[k]++;
+    }
+
+    void remember(const std::string& key,
+                  const rir::pir::JitLLVM::Compiled& code) {
+        assert(moduleUsers.count(moduleKey));
+        if (codeCache.count(key))
+            return;
+        if (code.pirTypeFeedback)
+            R_PreserveObject(code.pirTypeFeedback->container());
+        codeCache.emplace(key, CachedCode{moduleKey, code});
+    }
+
+    bool recall(const std::string& key, rir::Code* c,
+                rir::pir::JitLLVM::Compiled& res) {
+        auto cached = codeCache.find(key);
+        // The module might already be waiting for its removal
+        if (cached == codeCache.end() ||
+            !moduleUsers.count(cached->second.module))
+            return false;
+        attach(c, cached->second.module);
+        res = cached->second.code;
+        return true;
+    }
+
+    // Runs on the R thread, but possibly while the worker compiles. Thus the
+    // modules are only removed in createModule.
+    static void finalizeNativeCode(SEXP handle) {
+        auto uid = (rir::UUID*)R_ExternalPtrAddr(handle);
+        if (!uid)
+            return;
+        auto& jit = instance();
+        auto modules = jit.codeModules.find(*uid);
+        if (modules != jit.codeModules.end()) {
+            for (auto k : modules->second) {
+                if (--jit.moduleUsers.at(k) == 0) {
+                    jit.moduleUsers.erase(k);
+                    jit.deadModules.push_back(k);
+                }
+            }
+            jit.codeModules.erase(modules);
+        }
+        jit.tierUpCandidates.erase(*uid);
+        delete uid;
+        R_ClearExternalPtr(handle);
+    }
+
+    void perfName(llvm::Function* f, const std::string& name) {
+        perfNames[mangle(f->getName())] = name;
+    }
+
+    // Called once the object of a module is loaded, but before relocation
+    void recordSymbols(const object::ObjectFile& obj,
+                       const RuntimeDyld::LoadedObjectInfo& info) {
+        // Has the load addresses of the symbols
+        auto debugObj = info.getObjectForDebug(obj);
+        if (!debugObj.getBinary())
+            return;
+        for (auto& s : object::computeSymbolSizes(*debugObj.getBinary())) {
+            auto sym = s.first;
+            auto type = sym.getType();
+            if (!type) {
+                consumeError(type.takeError());
+                continue;
+            }
+            if (*type != object::SymbolRef::ST_Function || !s.second)
+                continue;
+            auto name = sym.getName();
+            if (!name) {
+                consumeError(name.takeError());
+                continue;
+            }
+            auto address = sym.getAddress();
+            if (!address) {
+                consumeError(address.takeError());
+                continue;
+            }
+            auto label = perfNames.find(name->str());
+            perfSymbols.push_back(
+                {label != perfNames.end() ? label->second : name->str(),
+                 *address, s.second});
+        }
+    }
+
+    void removeDeadModules() {
+        if (deadModules.empty())
+            return;
+        std::unordered_set<VModuleKey> dead(deadModules.begin(),
+                                            deadModules.end());
+        for (auto e = codeCache.begin(); e != codeCache.end();) {
+            if (dead.count(e->second.module)) {
+                if (auto feedback = e->second.code.pirTypeFeedback)
+                    R_ReleaseObject(feedback->container());
+                e = codeCache.erase(e);
+            } else {
+                ++e;
+            }
+        }
+        for (auto k : deadModules) {
+            if (k == moduleKey)
+                moduleKey = -1;
+            cantFail(OptimizeLayer.removeModule(k));
+        }
+        deadModules.clear();
+    }
+
+    void installTierUp(rir::Code* c, const std::string& name, void* n) {
+        c->nativeCode = (rir::NativeCode)n;
+        if (c->unboxedSignature)
+            c->nativeCodeUnboxed =
+                lookup(rir::pir::JitLLVM::unboxedEntry(name));
+    }
+
+    void* lookup(const std::string& name) {
+        auto adr = findSymbol(name).getAddress();
+        if (adr && *adr)
+            return (void*)*adr;
         return nullptr;
     }
 
+    // The current module is compiled by the worker with the next flush
+    void queue(const std::string& name, unsigned level,
+               const rir::pir::JitQueue::Installer& install) {
+        pending.push_back({module, name, level, std::move(builtins_),
+                           std::move(perfNames), install});
+        module = nullptr;
+        builtins_.clear();
+        perfNames.clear();
+    }
+
+    void flush() {
+        if (pending.empty())
+            return;
+        // Only one job in flight, the LLVM context is not thread safe
+        waitForWorker();
+        if (!workerThread.joinable())
+            workerThread = std::thread([this]() { worker(); });
+
+        std::lock_guard<std::mutex> guard(jobMutex);
+        job.reset(new Job);
+        job->modules = std::move(pending);
+        pending.clear();
+        jobCond.notify_all();
+    }
+
+    bool busy() const { return job != nullptr; }
+
+    void installFinished() {
+        if (!jobFinished)
+            return;
+        std::unique_ptr<Job> finished;
+        {
+            std::lock_guard<std::mutex> guard(jobMutex);
+            finished = std::move(job);
+            jobFinished = false;
+        }
+        for (auto& m : finished->modules) {
+            // The installer refers to the module compiled last, see attach,
+            // lookup and remember
+            moduleKey = m.key;
+            m.install(m.result);
+        }
+    }
+
+    void waitForWorker() {
+        if (!job)
+            return;
+        {
+            std::unique_lock<std::mutex> lock(jobMutex);
+            jobCond.wait(lock, [&]() { return job->done; });
+        }
+        installFinished();
+    }
+
     static JitLLVMImplementation& instance() {
         static std::unique_ptr<JitLLVMImplementation> singleton;
         if (!singleton) {
@@ -201,6 +525,71 @@ class JitLLVMImplementation {
     }
 
   private:
+    // Fast tier for functions which might get hot, full optimizations
+    // otherwise.
+    unsigned initialOptLevel(const std::string& name,
+                             rir::Code* tierUpTarget) {
+        if (!rir::pir::Parameter::PIR_LLVM_TIER_UP || !tierUpTarget ||
+            rir::pir::Parameter::PIR_LLVM_OPT_LEVEL == 0)
+            return rir::pir::Parameter::PIR_LLVM_OPT_LEVEL;
+
+        auto& candidate = tierUpCandidates[tierUpTarget->uid];
+        candidate.module = llvm::CloneModule(*module);
+        candidate.name = name;
+        candidate.builtins = builtins_;
+        candidate.perfNames = perfNames;
+        tierUpTarget->flags.set(rir::Code::NativeTierUp);
+        return 0;
+    }
+
+    void* compileCurrentModule(const std::string& name, unsigned level) {
+        // optimizeModule runs lazily when the symbol is looked up below
+        optLevel = level;
+        TM->setOptLevel(level == 0 ? CodeGenOpt::None : CodeGenOpt::Default);
+        moduleKey = ES.allocateVModule();
+        cantFail(OptimizeLayer.addModule(
+            moduleKey, std::unique_ptr<llvm::Module>(module)));
+        module = nullptr;
+        auto res = findSymbol(name);
+        auto adr = res.getAddress();
+        // The lookup finalized the code
+        if (!perfSymbols.empty()) {
+            rir::pir::PerfMap::write(perfSymbols);
+            perfSymbols.clear();
+        }
+        if (adr) {
+            assert(*adr);
+            return (void*)*adr;
+        }
+        return nullptr;
+    }
+
+    // The worker owns the JIT (module, layers and LLVM context) from the
+    // moment a job is queued until it is marked done. The R thread waits for
+    // it in createModule before touching any of them again.
+    void worker() {
+        std::unique_lock<std::mutex> lock(jobMutex);
+        while (true) {
+            jobCond.wait(lock,
+                         [&]() { return stopWorker || (job && !job->done); });
+            if (!job || job->done)
+                return;
+            lock.unlock();
+            for (auto& m : job->modules) {
+                module = m.module;
+                // Needed to resolve the symbols of the module
+                builtins_ = std::move(m.builtins);
+                perfNames = std::move(m.perfNames);
+                m.result = compileCurrentModule(m.name, m.optLevel);
+                m.key = moduleKey;
+            }
+            lock.lock();
+            job->done = true;
+            jobFinished = true;
+            jobCond.notify_all();
+        }
+    }
+
     JITSymbol findMangledSymbol(const std::string& Name) {
         auto l = builtins_.find(Name);
         if (l != builtins_.end()) {
@@ -253,8 +642,7 @@ class JitLLVMImplementation {
     optimizeModule(std::unique_ptr<llvm::Module> M);
 };
 
-static void pirPassSchedule(const PassManagerBuilder&,
-                            legacy::PassManagerBase& PM_) {
+static void pirPassSchedule(unsigned optLevel, legacy::PassManagerBase& PM_) {
     legacy::PassManagerBase* PM = &PM_;
 
     // See
@@ -264,19 +652,19 @@ static void pirPassSchedule(const PassManagerBuilder&,
     PM->add(createDeadInstEliminationPass());
     PM->add(createCFGSimplificationPass());
 
-    if (rir::pir::Parameter::PIR_LLVM_OPT_LEVEL > 0) {
+    if (optLevel > 0) {
         PM->add(createSROAPass());
         PM->add(createConstantPropagationPass());
         PM->add(createPromoteMemoryToRegisterPass());
     }
 
-    if (rir::pir::Parameter::PIR_LLVM_OPT_LEVEL > 1) {
+    if (optLevel > 1) {
         PM->add(createScopedNoAliasAAWrapperPass());
         PM->add(createTypeBasedAAWrapperPass());
         PM->add(createBasicAAWrapperPass());
     }
 
-    if (rir::pir::Parameter::PIR_LLVM_OPT_LEVEL > 0) {
+    if (optLevel > 0) {
         PM->add(createCFGSimplificationPass());
         PM->add(createDeadCodeEliminationPass());
         PM->add(createSROAPass());
@@ -287,7 +675,7 @@ static void pirPassSchedule(const PassManagerBuilder&,
         PM->add(createCFGSimplificationPass());
     }
 
-    if (rir::pir::Parameter::PIR_LLVM_OPT_LEVEL < 2)
+    if (optLevel < 2)
         return;
 
     PM->add(createSROAPass());
@@ -419,8 +807,11 @@ JitLLVMImplementation::optimizeModule(std::unique_ptr<llvm::Module> M) {
         TM->adjustPassManager(builder);
 
         // Start with some custom passes tailored to our backend
-        builder.addExtension(PassManagerBuilder::EP_EarlyAsPossible,
-                             pirPassSchedule);
+        builder.addExtension(
+            PassManagerBuilder::EP_EarlyAsPossible,
+            [this](const PassManagerBuilder&, PassManagerBase& PM) {
+                pirPassSchedule(optLevel, PM);
+            });
         builder.addExtension(
             PassManagerBuilder::EP_ModuleOptimizerEarly,
             [](const PassManagerBuilder&, PassManagerBase& PM) {
@@ -466,15 +857,54 @@ void JitLLVM::createModule() {
     JitLLVMImplementation::instance().createModule();
 }
 
-void* JitLLVM::tryCompile(llvm::Function* fun) {
+void* JitLLVM::tryCompile(llvm::Function* fun, rir::Code* tierUpTarget) {
     JitLLVMImplementation::instance();
-    return JitLLVMImplementation::instance().tryCompile(fun);
+    return JitLLVMImplementation::instance().tryCompile(fun, tierUpTarget);
+}
+
+void JitLLVM::tryCompileAsync(llvm::Function* fun, JitQueue::Installer install,
+                              rir::Code* tierUpTarget) {
+    JitLLVMImplementation::instance().tryCompileAsync(fun, install,
+                                                      tierUpTarget);
+}
+
+bool JitQueue::busy() { return JitLLVMImplementation::instance().busy(); }
+
+void JitQueue::flush() { JitLLVMImplementation::instance().flush(); }
+
+void JitQueue::installFinished() {
+    JitLLVMImplementation::instance().installFinished();
+}
+
+void JitQueue::tierUp(rir::Code* c) {
+    JitLLVMImplementation::instance().tierUp(c);
 }
 
 llvm::Function* JitLLVM::get(ClosureVersion* v) {
     return JitLLVMImplementation::instance().getFunction(v);
 }
 
+void JitLLVM::perfName(llvm::Function* f, const std::string& name) {
+    if (PerfMap::enabled())
+        JitLLVMImplementation::instance().perfName(f, name);
+}
+
+void JitLLVM::attach(rir::Code* c) {
+    JitLLVMImplementation::instance().attach(c);
+}
+
+void JitLLVM::remember(const std::string& key, const Compiled& code) {
+    JitLLVMImplementation::instance().remember(key, code);
+}
+
+bool JitLLVM::recall(const std::string& key, rir::Code* c, Compiled& res) {
+    return JitLLVMImplementation::instance().recall(key, c, res);
+}
+
+void* JitLLVM::lookup(const std::string& name) {
+    return JitLLVMImplementation::instance().lookup(name);
+}
+
 llvm::Function* JitLLVM::declare(ClosureVersion* v, const std::string& name,
                                  llvm::FunctionType* signature) {
     return JitLLVMImplementation::instance().declareFunction(v, name,
@@ -503,6 +933,12 @@ llvm::Module& JitLLVM::module() {
 
 unsigned Parameter::PIR_LLVM_OPT_LEVEL =
     getenv("PIR_LLVM_OPT_LEVEL") ? atoi(getenv("PIR_LLVM_OPT_LEVEL")) : 2;
+unsigned Parameter::PIR_LLVM_TIER_UP =
+    getenv("PIR_LLVM_TIER_UP") ? atoi(getenv("PIR_LLVM_TIER_UP")) : 0;
+bool Parameter::PIR_ASYNC_COMPILE =
+    getenv("PIR_ASYNC_COMPILE") ? atoi(getenv("PIR_ASYNC_COMPILE")) : false;
+bool Parameter::PIR_NATIVE_CACHE =
+    getenv("PIR_NATIVE_CACHE") ? atoi(getenv("PIR_NATIVE_CACHE")) : false;
 
 } // namespace pir
 } // namespace rir
@@ -2,11 +2,14 @@
 #define RIR_COMPILER_JIT_LLVM_H
 
 #include "builtins.h"
+#include "jit_queue.h"
 #include "llvm/ExecutionEngine/JITSymbol.h"
 #include "llvm/IR/Function.h"
 #include "llvm/IR/IRBuilder.h"
 
 namespace rir {
+struct Code;
+struct PirTypeFeedback;
 namespace pir {
 
 class ClosureVersion;
@@ -16,11 +19,40 @@ class JitLLVM {
     static llvm::LLVMContext C;
     static void createModule();
     static llvm::Module& module();
-    static void* tryCompile(llvm::Function*);
+    // If a tierUpTarget is given, the function is compiled with minimal
+    // optimizations first, see PIR_LLVM_TIER_UP
+    static void* tryCompile(llvm::Function*, rir::Code* tierUpTarget = nullptr);
+    static void tryCompileAsync(llvm::Function*, JitQueue::Installer,
+                                rir::Code* tierUpTarget = nullptr);
     static llvm::Function* declare(ClosureVersion* v, const std::string& name,
                                    llvm::FunctionType* signature);
     static llvm::Function* getBuiltin(const NativeBuiltin&);
     static llvm::Function* get(ClosureVersion* v);
+    // Name of the entry point with unboxed arguments of a native function, see
+    // UnboxedSignature in lower_llvm.cpp
+    static std::string unboxedEntry(const std::string& name) {
+        return name + "_unboxed";
+    }
+    // Address of a function of the module compiled last, nullptr if it has no
+    // such function
+    static void* lookup(const std::string& name);
+    // Releases the module compiled last, once the code object is collected
+    static void attach(rir::Code* c);
+
+    // What a code object needs to run the native code of a module
+    struct Compiled {
+        void* nativeCode;
+        void* nativeCodeUnboxed;
+        uint64_t unboxedSignature;
+        PirTypeFeedback* pirTypeFeedback;
+    };
+    // Remembers the native code of the module compiled last under the given
+    // key, for as long as the module lives, see PIR_NATIVE_CACHE
+    static void remember(const std::string& key, const Compiled& code);
+    // Native code remembered under the key, its module is attached to c
+    static bool recall(const std::string& key, rir::Code* c, Compiled& res);
+    // Name of the function in perf maps, see PIR_PERF_MAP
+    static void perfName(llvm::Function* f, const std::string& name);
     static llvm::Value* getFunctionDeclaration(const std::string& Name,
                                                llvm::FunctionType* signature,
                                                llvm::IRBuilder<>& builder);
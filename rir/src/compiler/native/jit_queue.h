@@ -0,0 +1,47 @@
+#ifndef RIR_COMPILER_JIT_QUEUE_H
+#define RIR_COMPILER_JIT_QUEUE_H
+
+#include <functional>
+
+namespace rir {
+struct Code;
+namespace pir {
+
+/*
+ * With PIR_ASYNC_COMPILE the LLVM half of the native backend (optimization and
+ * machine code generation) runs on a worker thread. Everything that touches
+ * the R heap (rir2pir, the PIR pipeline, pir2rir and lowering to LLVM IR)
+ * stays on the R thread. While the worker is busy the freshly installed
+ * version runs its PIR generated bytecode. The native code is patched in on
+ * the R thread once the worker is done.
+ *
+ * The modules lowered during one compilation (the body, promises and default
+ * arguments of all versions) are queued together by flush and compiled as one
+ * job. There is at most one job in flight, the LLVM context is not thread
+ * safe. Lowering the next module waits for the worker, but no compilation is
+ * started from rirCall while it is busy.
+ */
+struct JitQueue {
+    typedef std::function<void(void*)> Installer;
+
+    // True while a job is queued or being compiled
+    static bool busy();
+
+    // Hands the modules lowered since the last flush to the worker. Must only
+    // be called from the R thread.
+    static void flush();
+
+    // Runs the installer of a finished job (if there is one). Must only be
+    // called from the R thread.
+    static void installFinished();
+
+    // Recompiles the unoptimized native code of c with the full LLVM
+    // pipeline, see PIR_LLVM_TIER_UP. Does nothing if the worker is busy, the
+    // caller should try again later.
+    static void tierUp(rir::Code* c);
+};
+
+} // namespace pir
+} // namespace rir
+
+#endif
@@ -11,6 +11,9 @@
 #include "R/Symbols.h"
 #include "R/r.h"
 #include "builtins.h"
+#include "compiler/parameter.h"
+#include "perf_map.h"
+#include "vector_kernels.h"
 #include "compiler/analysis/liveness.h"
 #include "compiler/pir/pir_impl.h"
 #include "compiler/util/lowering/allocators.h"
@@ -18,6 +21,7 @@
 #include "interpreter/LazyEnvironment.h"
 #include "interpreter/builtins.h"
 #include "interpreter/instance.h"
+#include "interpreter/profiler.h"
 #include "runtime/DispatchTable.h"
 #include "utils/Pool.h"
 
@@ -26,6 +30,7 @@
 #include <cstdlib>
 #include <map>
 #include <memory>
+#include <sstream>
 #include <string>
 #include <unordered_map>
 #include <unordered_set>
@@ -112,11 +117,125 @@ static Representation representationOf(Value* v) {
     return representationOf(v->type);
 }
 
+// The LdArgs of arguments passed unboxed, with their representation. Their
+// PIR type is still promise wrapped, but the lowered code receives the value.
+typedef std::unordered_map<Value*, Representation> UnboxedLdArgs;
+
+// Calling convention of the unboxed entry point of a native version. Arguments
+// which the context proves to be simple int or real scalars are passed as int
+// or double, after the parameters of the usual native signature. Their stack
+// slots are not read, except to box them on deopt. The result is unboxed too,
+// if all returns of the version return an int or a real scalar.
+struct UnboxedSignature {
+    // Trailing arguments are passed boxed
+    std::vector<Representation> args;
+    Representation ret = Representation::Sexp;
+
+    UnboxedSignature() {}
+    // Only versions without reflection are called directly from native code
+    explicit UnboxedSignature(ClosureVersion* cls) {
+        if (!cls->properties.includes(ClosureVersion::Property::NoReflection))
+            return;
+
+        auto& context = cls->context();
+        for (size_t i = 0; i < cls->nargs() && i < Context::NUM_TYPED_ARGS;
+             ++i) {
+            if (context.isSimpleInt(i))
+                args.push_back(Representation::Integer);
+            else if (context.isSimpleReal(i))
+                args.push_back(Representation::Real);
+            else
+                args.push_back(Representation::Sexp);
+        }
+        while (!args.empty() && args.back() == Representation::Sexp)
+            args.pop_back();
+
+        PirType res = PirType::bottom();
+        bool returns = false;
+        Visitor::run(cls->entry, [&](Instruction* i) {
+            if (auto r = Return::Cast(i)) {
+                res = res | r->arg<0>().val()->type;
+                returns = true;
+            }
+        });
+        if (returns) {
+            if (res.isA(PirType(RType::integer).scalar().noAttribs()))
+                ret = Representation::Integer;
+            else if (res.isA(PirType(RType::real).scalar().noAttribs()))
+                ret = Representation::Real;
+        }
+    }
+
+    Representation arg(size_t i) const {
+        return i < args.size() ? args[i] : Representation::Sexp;
+    }
+
+    bool trivial() const {
+        return args.empty() && ret == Representation::Sexp;
+    }
+
+    // Can the arguments of a call be passed in this signature?
+    bool accepts(const std::vector<Value*>& callArgs) const {
+        if (callArgs.size() < args.size())
+            return false;
+        for (size_t i = 0; i < args.size(); ++i) {
+            if (args[i] == Representation::Integer &&
+                !callArgs[i]->type.isA(
+                    PirType(RType::integer).scalar().notObject()))
+                return false;
+            if (args[i] == Representation::Real &&
+                !callArgs[i]->type.isA(
+                    PirType(RType::real).scalar().notObject()))
+                return false;
+        }
+        return true;
+    }
+
+    // Stored in rir::Code::unboxedSignature, for native callers to check at
+    // runtime that the callee was compiled with the signature they expect
+    uint64_t encode() const {
+        if (trivial())
+            return 0;
+        uint64_t res = ret.t;
+        for (size_t i = 0; i < args.size(); ++i)
+            res |= (uint64_t)args[i].t << (2 * (i + 1));
+        return res;
+    }
+
+    FunctionType* type() const {
+        std::vector<llvm::Type*> params(t::nativeFunction->param_begin(),
+                                        t::nativeFunction->param_end());
+        for (auto a : args)
+            if (a != Representation::Sexp)
+                params.push_back(a);
+        auto r = ret;
+        return FunctionType::get(r, params, false);
+    }
+};
+
+// The version in the dispatch table of target, which a static call with nargs
+// arguments can call into
+static rir::Function* nativeTargetOf(ClosureVersion* target, size_t nargs) {
+    auto dt = DispatchTable::check(BODY(target->owner()->rirClosure()));
+    rir::Function* res = nullptr;
+    for (size_t i = 0; i < dt->size(); i++) {
+        auto entry = dt->get(i);
+        if (entry->context() == target->context() &&
+            entry->signature().numArguments >= nargs)
+            res = entry;
+    }
+    return res;
+}
+
 class NativeAllocator : public SSAAllocator {
   public:
     NativeAllocator(Code* code, ClosureVersion* cls,
-                    const LivenessIntervals& livenessIntervals, LogStream& log)
-        : SSAAllocator(code, cls, livenessIntervals, false, log) {}
+                    const LivenessIntervals& livenessIntervals,
+                    const UnboxedLdArgs& unboxedLdArgs, LogStream& log)
+        : SSAAllocator(code, cls, livenessIntervals, false, log),
+          unboxedLdArgs(unboxedLdArgs) {}
+
+    const UnboxedLdArgs& unboxedLdArgs;
 
     bool needsAVariable(Value* v) const {
         return v->producesRirResult() && !LdConst::Cast(v) &&
@@ -124,7 +243,8 @@ class NativeAllocator : public SSAAllocator {
                  LdConst::Cast(CastType::Cast(v)->arg(0).val()));
     }
     bool needsASlot(Value* v) const override final {
-        return needsAVariable(v) && representationOf(v) == t::SEXP;
+        return needsAVariable(v) && !unboxedLdArgs.count(v) &&
+               representationOf(v) == t::SEXP;
     }
     bool interfere(Instruction* a, Instruction* b) const override final {
         // Ensure we preserve slots for variables with typefeedback to make them
@@ -176,9 +296,28 @@ class LowerFunctionLLVM {
 
   public:
     PirTypeFeedback* pirTypeFeedback = nullptr;
+    // The code is lowered into fun. If it has an unboxed signature, fun is
+    // the unboxed entry point, boxedEntry unboxes the arguments and calls it.
     llvm::Function* fun;
+    llvm::Function* boxedEntry;
+    UnboxedSignature unboxed;
+    UnboxedLdArgs unboxedLdArgs;
     MkEnv* myPromenv = nullptr;
 
+    // Unboxed arguments are represented (and typed) as their value
+    Representation representationOf(Value* v) const {
+        auto u = unboxedLdArgs.find(v);
+        if (u != unboxedLdArgs.end())
+            return u->second;
+        return pir::representationOf(v);
+    }
+    static Representation representationOf(PirType t) {
+        return pir::representationOf(t);
+    }
+    bool maybePromiseWrapped(Value* v) const {
+        return !unboxedLdArgs.count(v) && v->type.maybePromiseWrapped();
+    }
+
     LowerFunctionLLVM(
         const std::string& name, ClosureVersion* cls, Code* code,
         const std::unordered_map<Code*, std::pair<unsigned, MkEnv*>>& promMap,
@@ -192,7 +331,31 @@ class LowerFunctionLLVM {
           branchAlwaysFalse(MDB.createBranchWeights(1, 100000000)),
           branchMostlyTrue(MDB.createBranchWeights(1000, 1)),
           branchMostlyFalse(MDB.createBranchWeights(1, 1000)) {
-        fun = JitLLVM::declare(cls, name, t::nativeFunction);
+        boxedEntry = fun = JitLLVM::declare(cls, name, t::nativeFunction);
+        if (code == cls)
+            unboxed = UnboxedSignature(cls);
+        if (!unboxed.trivial()) {
+            fun = Function::Create(unboxed.type(), Function::ExternalLinkage,
+                                   JitLLVM::unboxedEntry(name),
+                                   &JitLLVM::module());
+            fun->addFnAttr(Attribute::NoUnwind);
+            // The core receives the values of these arguments, never the
+            // (forced) promises from the stack, thus they stay unboxed
+            Visitor::run(code->entry, [&](Instruction* i) {
+                if (auto ld = LdArg::Cast(i))
+                    if (unboxed.arg(ld->id) != Representation::Sexp)
+                        unboxedLdArgs.emplace(ld, unboxed.arg(ld->id));
+            });
+        }
+        if (PerfMap::enabled()) {
+            std::stringstream perfName;
+            perfName << cls->owner()->name() << "[" << cls->context() << "]";
+            if (code != cls)
+                perfName << " promise";
+            JitLLVM::perfName(boxedEntry, perfName.str());
+            if (fun != boxedEntry)
+                JitLLVM::perfName(fun, perfName.str() + " unboxed");
+        }
         // prevent Wunused
         this->cls->size();
         this->promMap.size();
@@ -440,6 +603,8 @@ class LowerFunctionLLVM {
 
     std::array<std::string, 4> argNames = {{"code", "args", "env", "closure"}};
     std::vector<llvm::Value*> args;
+    // The parameters of the arguments passed unboxed, indexed by argument
+    std::vector<llvm::Value*> unboxedArgs;
     llvm::Value* paramCode() { return args[0]; }
     llvm::Value* paramArgs() { return args[1]; }
     llvm::Value* paramEnv() { return args[2]; }
@@ -489,6 +654,13 @@ class LowerFunctionLLVM {
     llvm::AllocaInst* topAlloca(llvm::Type* t, size_t len = 1);
 
     llvm::Value* argument(int i);
+    llvm::Value* argumentPos(llvm::Value* args, int i);
+    void boxUnboxedArgs();
+    void compileBoxedEntry();
+    llvm::Value* callUnboxed(llvm::Value* callee, const UnboxedSignature& sig,
+                             const std::vector<Value*>& args,
+                             llvm::Value* code, llvm::Value* env,
+                             llvm::Value* closure, Instruction* i);
     llvm::Value* convert(llvm::Value* val, PirType to, bool protect = true);
     void setVal(Instruction* i, llvm::Value* val);
 
@@ -559,7 +731,7 @@ class LowerFunctionLLVM {
     void insn_assert(llvm::Value* v, const char* msg, llvm::Value* p = nullptr);
     llvm::Value* depromise(llvm::Value* arg, const PirType& t);
     llvm::Value* depromise(Value* v) {
-        if (!v->type.maybePromiseWrapped())
+        if (!maybePromiseWrapped(v))
             return loadSxp(v);
         assert(representationOf(v) == t::SEXP);
         return depromise(loadSxp(v), v->type);
@@ -569,7 +741,8 @@ class LowerFunctionLLVM {
 
     llvm::Value* computeAndCheckIndex(Value* index, llvm::Value* vector,
                                       BasicBlock* fallback,
-                                      llvm::Value* max = nullptr);
+                                      llvm::Value* max = nullptr,
+                                      bool inBounds = false);
     bool compileDotcall(Instruction* i,
                         const std::function<llvm::Value*()>& callee,
                         const std::function<SEXP(size_t)>& names);
@@ -612,7 +785,8 @@ class LowerFunctionLLVM {
     bool success = true;
     bool tryCompile();
 
-    bool tryInlineBuiltin(int builtin);
+    bool tryInlineBuiltin(CallSafeBuiltin* b,
+                          const std::function<llvm::Value*()>& callTheBuiltin);
 
     llvm::Value* createSelect2(llvm::Value* cond,
                                std::function<llvm::Value*()> trueValueAction,
@@ -982,7 +1156,8 @@ llvm::Value* LowerFunctionLLVM::load(Value* val, PirType type,
 llvm::Value* LowerFunctionLLVM::computeAndCheckIndex(Value* index,
                                                      llvm::Value* vector,
                                                      BasicBlock* fallback,
-                                                     llvm::Value* max) {
+                                                     llvm::Value* max,
+                                                     bool inBounds) {
     BasicBlock* hit1 = BasicBlock::Create(C, "", fun);
     BasicBlock* hit = BasicBlock::Create(C, "", fun);
 
@@ -999,29 +1174,39 @@ llvm::Value* LowerFunctionLLVM::computeAndCheckIndex(Value* index,
         }
     }
 
-    if (representation == Representation::Real) {
-        auto indexUnderRange = builder.CreateFCmpULT(nativeIndex, c(1.0));
-        auto indexOverRange =
-            builder.CreateFCmpUGE(nativeIndex, c((double)ULONG_MAX));
-        auto indexNa = builder.CreateFCmpUNE(nativeIndex, nativeIndex);
-        auto fail = builder.CreateOr(indexUnderRange,
-                                     builder.CreateOr(indexOverRange, indexNa));
-
-        builder.CreateCondBr(fail, fallback, hit1, branchMostlyFalse);
-        builder.SetInsertPoint(hit1);
+    // If the index is known to be in bounds (see BoundsChecks), only NA needs
+    // to be ruled out
+    bool checkNa = !inBounds || index->type.maybeNAOrNaN();
+    llvm::Value* fail = nullptr;
+    auto addCheck = [&](llvm::Value* check) {
+        fail = fail ? builder.CreateOr(fail, check) : check;
+    };
 
-        nativeIndex = builder.CreateFPToUI(nativeIndex, t::i64);
+    if (representation == Representation::Real) {
+        if (!inBounds) {
+            addCheck(builder.CreateFCmpULT(nativeIndex, c(1.0)));
+            addCheck(builder.CreateFCmpUGE(nativeIndex, c((double)ULONG_MAX)));
+        }
+        if (checkNa)
+            addCheck(builder.CreateFCmpUNE(nativeIndex, nativeIndex));
     } else {
         assert(representation == Representation::Integer);
-        auto indexUnderRange = builder.CreateICmpSLT(nativeIndex, c(1));
-        auto indexNa = builder.CreateICmpEQ(nativeIndex, c(NA_INTEGER));
-        auto fail = builder.CreateOr(indexUnderRange, indexNa);
+        if (!inBounds)
+            addCheck(builder.CreateICmpSLT(nativeIndex, c(1)));
+        if (checkNa)
+            addCheck(builder.CreateICmpEQ(nativeIndex, c(NA_INTEGER)));
+    }
 
+    if (fail)
         builder.CreateCondBr(fail, fallback, hit1, branchMostlyFalse);
-        builder.SetInsertPoint(hit1);
+    else
+        builder.CreateBr(hit1);
+    builder.SetInsertPoint(hit1);
 
+    if (representation == Representation::Real)
+        nativeIndex = builder.CreateFPToUI(nativeIndex, t::i64);
+    else
         nativeIndex = builder.CreateZExt(nativeIndex, t::i64);
-    }
     // R indexing is 1-based
     nativeIndex = builder.CreateSub(nativeIndex, c(1ul), "", true, true);
 
@@ -1029,8 +1214,12 @@ llvm::Value* LowerFunctionLLVM::computeAndCheckIndex(Value* index,
     assert(ty == t::SEXP || ty == t::Int || ty == t::Double);
     if (!max)
         max = (ty == t::SEXP) ? vectorLength(vector) : c(1ul);
-    auto indexOverRange = builder.CreateICmpUGE(nativeIndex, max);
-    builder.CreateCondBr(indexOverRange, fallback, hit, branchMostlyFalse);
+    if (inBounds) {
+        builder.CreateBr(hit);
+    } else {
+        auto indexOverRange = builder.CreateICmpUGE(nativeIndex, max);
+        builder.CreateCondBr(indexOverRange, fallback, hit, branchMostlyFalse);
+    }
     builder.SetInsertPoint(hit);
     return nativeIndex;
 }
@@ -1282,10 +1471,90 @@ llvm::Value* LowerFunctionLLVM::unboxRealIntLgl(llvm::Value* v,
     return res();
 }
 
+llvm::Value* LowerFunctionLLVM::argumentPos(llvm::Value* args, int i) {
+    auto pos = builder.CreateGEP(args, c(i));
+    return builder.CreateGEP(pos, {c(0), c(1)});
+}
+
 llvm::Value* LowerFunctionLLVM::argument(int i) {
-    auto pos = builder.CreateGEP(paramArgs(), c(i));
-    pos = builder.CreateGEP(pos, {c(0), c(1)});
-    return builder.CreateLoad(t::SEXP, pos);
+    return builder.CreateLoad(t::SEXP, argumentPos(paramArgs(), i));
+}
+
+// The baseline reads all arguments from the stack
+void LowerFunctionLLVM::boxUnboxedArgs() {
+    for (size_t i = 0; i < unboxedArgs.size(); ++i) {
+        auto arg = unboxedArgs[i];
+        if (!arg)
+            continue;
+        auto boxed = unboxed.arg(i) == Representation::Integer
+                         ? boxInt(arg, false)
+                         : boxReal(arg, false);
+        builder.CreateStore(boxed, argumentPos(paramArgs(), i));
+    }
+}
+
+// Unboxes the arguments from the stack and calls the unboxed entry point
+void LowerFunctionLLVM::compileBoxedEntry() {
+    // The helpers below add their blocks to fun
+    auto core = fun;
+    fun = boxedEntry;
+    builder.SetInsertPoint(BasicBlock::Create(C, "", fun));
+
+    std::vector<llvm::Value*> callArgs;
+    for (auto& a : fun->args())
+        callArgs.push_back(&a);
+    auto stackArgs = callArgs[1];
+    for (size_t i = 0; i < unboxed.args.size(); ++i) {
+        auto r = unboxed.arg(i);
+        if (r == Representation::Sexp)
+            continue;
+        // The context allows forced promises of simple scalars
+        auto arg = depromise(
+            builder.CreateLoad(t::SEXP, argumentPos(stackArgs, i)),
+            PirType::any());
+        if (r == Representation::Integer)
+            callArgs.push_back(unboxIntLgl(arg));
+        else
+            callArgs.push_back(
+                unboxRealIntLgl(arg, PirType::simpleScalarReal()));
+    }
+
+    llvm::Value* res = builder.CreateCall(core, callArgs);
+    if (unboxed.ret == Representation::Integer)
+        res = boxInt(res, false);
+    else if (unboxed.ret == Representation::Real)
+        res = boxReal(res, false);
+    builder.CreateRet(res);
+
+    fun = core;
+}
+
+// Scalar arguments are passed unboxed, their stack slots hold nil. The result
+// is converted to the representation of i.
+llvm::Value* LowerFunctionLLVM::callUnboxed(
+    llvm::Value* callee, const UnboxedSignature& sig,
+    const std::vector<Value*>& args, llvm::Value* code, llvm::Value* env,
+    llvm::Value* closure, Instruction* i) {
+    std::vector<Value*> stackArgs;
+    std::vector<llvm::Value*> callArgs = {code, nodestackPtr(), env, closure};
+    for (size_t a = 0; a < args.size(); ++a) {
+        auto r = sig.arg(a);
+        if (r == Representation::Sexp) {
+            stackArgs.push_back(args[a]);
+        } else {
+            stackArgs.push_back(Nil::instance());
+            callArgs.push_back(load(args[a], r));
+        }
+    }
+
+    auto res = withCallFrame(stackArgs, [&]() -> llvm::Value* {
+        return builder.CreateCall(callee, callArgs);
+    });
+    if (sig.ret != Representation::Sexp &&
+        representationOf(i) == Representation::Sexp)
+        return sig.ret == Representation::Integer ? boxInt(res, false)
+                                                  : boxReal(res, false);
+    return convert(res, i->type, false);
 }
 
 AllocaInst* LowerFunctionLLVM::topAlloca(llvm::Type* t, size_t len) {
@@ -2248,11 +2517,71 @@ llvm::Value* LowerFunctionLLVM::isAltrep(llvm::Value* v) {
         builder.CreateAnd(sxpinfo, c((unsigned long)(1ul << (TYPE_BITS + 2)))));
 };
 
-bool LowerFunctionLLVM::tryInlineBuiltin(int builtin) {
-    switch (builtin) {}
-    return false;
+// Math builtins which are compiled to an LLVM intrinsic for scalars and to a
+// vector kernel for plain vectors. R passes NA and NaN elements through and
+// warns if a NaN is produced from a number, e.g. sqrt(-1).
+struct InlineMath1 {
+    Intrinsic::ID intrinsic;
+    Math1Kind kind;
+    bool mayProduceNaN;
 };
 
+bool LowerFunctionLLVM::tryInlineBuiltin(
+    CallSafeBuiltin* b, const std::function<llvm::Value*()>& callTheBuiltin) {
+    static const std::unordered_map<int, InlineMath1> math1 = {
+        {blt("sqrt"), {Intrinsic::sqrt, Math1Kind::SQRT, true}},
+        {blt("exp"), {Intrinsic::exp, Math1Kind::EXP, false}},
+        {blt("floor"), {Intrinsic::floor, Math1Kind::FLOOR, false}},
+        {blt("ceiling"), {Intrinsic::ceil, Math1Kind::CEILING, false}},
+        {blt("sin"), {Intrinsic::sin, Math1Kind::SIN, true}},
+        {blt("cos"), {Intrinsic::cos, Math1Kind::COS, true}},
+        {blt("log2"), {Intrinsic::log2, Math1Kind::LOG2, true}},
+        {blt("log10"), {Intrinsic::log10, Math1Kind::LOG10, true}},
+    };
+
+    auto m = math1.find(b->builtinId);
+    if (m == math1.end() || b->nCallArgs() != 1)
+        return false;
+
+    auto arg = b->callArg(0).val();
+    auto irep = representationOf(arg);
+    auto orep = representationOf(b);
+    if (orep == Representation::Integer)
+        return false;
+
+    if (irep != Representation::Sexp) {
+        auto x = convert(load(arg), PirType::simpleScalarReal());
+        llvm::Value* res = builder.CreateIntrinsic(m->second.intrinsic,
+                                                   {t::Double}, {x});
+        res = builder.CreateSelect(builder.CreateFCmpUNO(x, x), x, res);
+        if (m->second.mayProduceNaN) {
+            // Let R emit the warning
+            auto nan = builder.CreateAnd(builder.CreateFCmpUNO(res, res),
+                                         builder.CreateFCmpORD(x, x));
+            res = createSelect2(nan,
+                                [&]() { return unboxReal(callTheBuiltin()); },
+                                [&]() { return res; });
+        }
+        if (orep == Representation::Sexp)
+            res = boxReal(res);
+        setVal(b, res);
+        return true;
+    }
+
+    // Attributes are checked at runtime by the kernel
+    static const PirType numbers =
+        (PirType(RType::logical) | RType::integer | RType::real).orAttribs();
+    if (orep != Representation::Sexp || !arg->type.isA(numbers))
+        return false;
+    auto x = loadSxp(arg);
+    auto res = call(NativeBuiltins::math1,
+                    {x, c((int)m->second.kind), c(b->srcIdx)});
+    setVal(b, createSelect2(
+                  builder.CreateICmpEQ(res, convertToPointer(nullptr, t::SEXP)),
+                  [&]() { return callTheBuiltin(); }, [&]() { return res; }));
+    return true;
+}
+
 llvm::Value* LowerFunctionLLVM::createSelect2(
     llvm::Value* cond, std::function<llvm::Value*()> trueValueAction,
     std::function<llvm::Value*()> falseValueAction) {
@@ -2326,6 +2655,15 @@ bool LowerFunctionLLVM::tryCompile() {
             args.back()->setName(argNames[i]);
             arg++;
         }
+        for (size_t i = 0; i < unboxed.args.size(); ++i) {
+            if (unboxed.arg(i) == Representation::Sexp) {
+                unboxedArgs.push_back(nullptr);
+                continue;
+            }
+            unboxedArgs.push_back(arg);
+            arg->setName("arg" + std::to_string(i));
+            arg++;
+        }
     }
 
     std::unordered_map<BB*, BasicBlock*> blockMapping_;
@@ -2344,11 +2682,14 @@ bool LowerFunctionLLVM::tryCompile() {
                                         PointerType::get(t::stackCellPtr, 0));
     basepointer = nodestackPtr();
 
-    numLocals++;
-    // Store the code object as the first element of our frame, for the value
-    // profiler to find it.
-    incStack(1, false);
-    stack({container(paramCode())});
+    // The frame starts with a marker followed by the code object, for the
+    // runtime profiler to find it. The marker is stored last, such that a
+    // sample never sees it without the code.
+    numLocals += 2;
+    incStack(2, true);
+    setLocal(1, container(paramCode()));
+    // The marker is preserved forever, it does not need the constant pool
+    setLocal(0, convertToPointer(RuntimeProfiler::nativeFrameMarker));
     {
         SmallSet<std::pair<Value*, SEXP>> bindings;
         Visitor::run(code->entry, [&](Instruction* i) {
@@ -2376,7 +2717,7 @@ bool LowerFunctionLLVM::tryCompile() {
 
     std::unordered_map<Instruction*, Instruction*> phis;
     {
-        NativeAllocator allocator(code, cls, liveness, log);
+        NativeAllocator allocator(code, cls, liveness, unboxedLdArgs, log);
         allocator.compute();
         allocator.verify();
         auto numLocalsBase = numLocals;
@@ -2553,9 +2894,14 @@ bool LowerFunctionLLVM::tryCompile() {
             case Tag::Phi:
                 break;
 
-            case Tag::LdArg:
-                setVal(i, argument(LdArg::Cast(i)->id));
+            case Tag::LdArg: {
+                auto id = LdArg::Cast(i)->id;
+                if (id < unboxedArgs.size() && unboxedArgs[id])
+                    setVal(i, unboxedArgs[id]);
+                else
+                    setVal(i, argument(id));
                 break;
+            }
 
             case Tag::LdFunctionEnv:
                 setVal(i, paramEnv());
@@ -2782,6 +3128,11 @@ bool LowerFunctionLLVM::tryCompile() {
                     }
                 }
 
+                if (tryInlineBuiltin(b, callTheBuiltin)) {
+                    fixVisibility();
+                    break;
+                }
+
                 if (b->nargs() == 1) {
                     auto a = load(b->callArg(0).val());
                     auto irep = representationOf(b->arg(0).val());
@@ -2891,21 +3242,6 @@ bool LowerFunctionLLVM::tryCompile() {
                         }
                         break;
                     }
-                    case blt("sqrt"): {
-                        if (orep == Representation::Real &&
-                            irep == Representation::Integer) {
-                            a = convert(a, i->type);
-                            setVal(i, builder.CreateIntrinsic(
-                                          Intrinsic::sqrt, {t::Double}, {a}));
-                        } else if (orep == irep &&
-                                   irep == Representation::Real) {
-                            setVal(i, builder.CreateIntrinsic(
-                                          Intrinsic::sqrt, {t::Double}, {a}));
-                        } else {
-                            done = false;
-                        }
-                        break;
-                    }
                     case blt("sum"):
                     case blt("prod"): {
                         if (irep == Representation::Integer ||
@@ -3389,16 +3725,8 @@ bool LowerFunctionLLVM::tryCompile() {
 
                 if (target == bestTarget) {
                     auto callee = target->owner()->rirClosure();
-                    auto dt = DispatchTable::check(BODY(callee));
                     assert(cls);
-                    rir::Function* nativeTarget = nullptr;
-                    for (size_t i = 0; i < dt->size(); i++) {
-                        auto entry = dt->get(i);
-                        if (entry->context() == target->context() &&
-                            entry->signature().numArguments >= args.size()) {
-                            nativeTarget = entry;
-                        }
-                    }
+                    auto nativeTarget = nativeTargetOf(target, args.size());
                     if (nativeTarget) {
                         llvm::Value* trg = JitLLVM::get(target);
                         if (trg &&
@@ -3406,6 +3734,15 @@ bool LowerFunctionLLVM::tryCompile() {
                                 ClosureVersion::Property::NoReflection)) {
                             auto code = builder.CreateIntToPtr(
                                 c(nativeTarget->body()), t::voidPtr);
+                            // A recursive call
+                            if (trg == boxedEntry && fun != boxedEntry &&
+                                unboxed.accepts(args)) {
+                                setVal(i, callUnboxed(
+                                              fun, unboxed, args, code,
+                                              loadSxp(i->env()),
+                                              constant(callee, t::SEXP), i));
+                                break;
+                            }
                             llvm::Value* arglist = nodestackPtr();
                             auto rr = withCallFrame(args, [&]() {
                                 return builder.CreateCall(
@@ -3421,18 +3758,127 @@ bool LowerFunctionLLVM::tryCompile() {
                         auto idx = Pool::makeSpace();
                         Pool::patch(idx, nativeTarget->container());
                         assert(asmpt.smaller(nativeTarget->context()));
-                        auto res = withCallFrame(args, [&]() {
-                            return call(NativeBuiltins::nativeCallTrampoline,
-                                        {
-                                            constant(callee, t::SEXP),
-                                            c(idx),
-                                            c(calli->srcIdx),
-                                            loadSxp(calli->env()),
-                                            c(args.size()),
-                                            c(asmpt.toI()),
-                                        });
-                        });
-                        setVal(i, res);
+                        auto trampoline = [&]() {
+                            return withCallFrame(args, [&]() {
+                                return call(
+                                    NativeBuiltins::nativeCallTrampoline,
+                                    {
+                                        constant(callee, t::SEXP),
+                                        c(idx),
+                                        c(calli->srcIdx),
+                                        loadSxp(calli->env()),
+                                        c(args.size()),
+                                        c(asmpt.toI()),
+                                    });
+                            });
+                        };
+
+                        if (!target->properties.includes(
+                                ClosureVersion::Property::NoReflection)) {
+                            setVal(i, trampoline());
+                            break;
+                        }
+
+                        // The target does not need a context, thus we can
+                        // call its native code directly. The trampoline
+                        // counts invocations, recompiles and tiers up the
+                        // target, and tells us how many calls can skip it
+                        // (none if the target was removed from the dispatch
+                        // table), see DirectCallBudget.
+                        auto budgetPtr = convertToPointer(
+                            &nativeTarget->body()->directCalls,
+                            PointerType::get(t::i32, 0));
+                        auto budget = builder.CreateLoad(budgetPtr);
+                        auto nativeCode = builder.CreateLoad(convertToPointer(
+                            &nativeTarget->body()->nativeCode,
+                            PointerType::get(t::nativeFunctionPtr, 0)));
+                        auto missingCode = builder.CreateICmpEQ(
+                            nativeCode,
+                            llvm::ConstantPointerNull::get(
+                                PointerType::get(t::nativeFunction, 0)));
+
+                        auto direct = BasicBlock::Create(C, "", fun);
+                        auto slow = BasicBlock::Create(C, "", fun);
+                        auto done = BasicBlock::Create(C, "", fun);
+                        builder.CreateCondBr(
+                            builder.CreateOr(
+                                builder.CreateICmpEQ(budget, c(0)),
+                                missingCode),
+                            slow, direct, branchMostlyFalse);
+
+                        auto res = phiBuilder(representationOf(i));
+                        builder.SetInsertPoint(direct);
+                        builder.CreateStore(builder.CreateSub(budget, c(1)),
+                                            budgetPtr);
+                        auto countPtr = convertToPointer(
+                            &nativeTarget->body()->funInvocationCount,
+                            PointerType::get(t::i32, 0));
+                        auto count = builder.CreateLoad(countPtr);
+                        builder.CreateStore(
+                            builder.CreateSelect(
+                                builder.CreateICmpEQ(count, c(UINT_MAX)),
+                                count, builder.CreateAdd(count, c(1))),
+                            countPtr);
+                        // Trailing missing args are not passed by the caller
+                        std::vector<Value*> allArgs(args);
+                        while (allArgs.size() < nativeTarget->nargs())
+                            allArgs.push_back(MissingArg::instance());
+                        auto code = builder.CreateIntToPtr(
+                            c(nativeTarget->body()), t::voidPtr);
+
+                        // Prefer the unboxed entry point, if the target was
+                        // compiled with the signature we expect
+                        UnboxedSignature sig(target);
+                        if (!sig.trivial() && sig.accepts(args)) {
+                            auto sigPtr = PointerType::get(sig.type(), 0);
+                            auto unboxedCode =
+                                builder.CreateLoad(convertToPointer(
+                                    &nativeTarget->body()->nativeCodeUnboxed,
+                                    PointerType::get(sigPtr, 0)));
+                            auto signature =
+                                builder.CreateLoad(convertToPointer(
+                                    &nativeTarget->body()->unboxedSignature,
+                                    t::i64ptr));
+                            auto matches = builder.CreateAnd(
+                                builder.CreateICmpNE(
+                                    unboxedCode,
+                                    llvm::ConstantPointerNull::get(sigPtr)),
+                                builder.CreateICmpEQ(signature,
+                                                     c(sig.encode())));
+                            auto callUnboxedBB = BasicBlock::Create(C, "", fun);
+                            auto callBoxedBB = BasicBlock::Create(C, "", fun);
+                            builder.CreateCondBr(matches, callUnboxedBB,
+                                                 callBoxedBB, branchMostlyTrue);
+
+                            builder.SetInsertPoint(callUnboxedBB);
+                            res.addInput(callUnboxed(
+                                unboxedCode, sig, allArgs, code,
+                                loadSxp(i->env()), constant(callee, t::SEXP),
+                                i));
+                            builder.CreateBr(done);
+
+                            builder.SetInsertPoint(callBoxedBB);
+                        }
+
+                        llvm::Value* arglist = nodestackPtr();
+                        res.addInput(convert(
+                            withCallFrame(allArgs,
+                                          [&]() {
+                                              return builder.CreateCall(
+                                                  nativeCode,
+                                                  {code, arglist,
+                                                   loadSxp(i->env()),
+                                                   constant(callee, t::SEXP)});
+                                          }),
+                            i->type, false));
+                        builder.CreateBr(done);
+
+                        builder.SetInsertPoint(slow);
+                        res.addInput(convert(trampoline(), i->type, false));
+                        builder.CreateBr(done);
+
+                        builder.SetInsertPoint(done);
+                        setVal(i, res());
                         break;
                     }
                 }
@@ -3521,6 +3967,7 @@ bool LowerFunctionLLVM::tryCompile() {
                     Pool::insert(store);
                 }
 
+                boxUnboxedArgs();
                 std::vector<Value*> args;
                 i->eachArg([&](Value* v) { args.push_back(v); });
                 llvm::CallInst* res;
@@ -3817,6 +4264,44 @@ bool LowerFunctionLLVM::tryCompile() {
                              },
                              BinopKind::LOR);
                 break;
+            case Tag::VectorExpr: {
+                auto e = VectorExpr::Cast(i);
+                // The program is a constant of the native code, not an R
+                // object in the constant pool
+                std::vector<unsigned> program;
+                for (auto o : e->ops) {
+                    int op = VectorExprArg;
+                    switch (o) {
+                    case VectorExpr::Op::Arg:
+                        break;
+                    case VectorExpr::Op::Add:
+                        op = (int)BinopKind::ADD;
+                        break;
+                    case VectorExpr::Op::Sub:
+                        op = (int)BinopKind::SUB;
+                        break;
+                    case VectorExpr::Op::Mul:
+                        op = (int)BinopKind::MUL;
+                        break;
+                    case VectorExpr::Op::Div:
+                        op = (int)BinopKind::DIV;
+                        break;
+                    }
+                    program.push_back((unsigned)op);
+                }
+                auto programStore = globalConst(c(program));
+
+                std::vector<Value*> args;
+                e->eachArg([&](Value* v) { args.push_back(v); });
+                setVal(i, withCallFrame(args, [&]() -> llvm::Value* {
+                           return call(
+                               NativeBuiltins::vectorExpr,
+                               {builder.CreateBitCast(programStore, t::IntPtr),
+                                c(program.size()), c(e->srcIdx),
+                                c(e->nargs())});
+                       }));
+                break;
+            }
             case Tag::IDiv:
                 compileBinop(
                     i,
@@ -3985,7 +4470,7 @@ bool LowerFunctionLLVM::tryCompile() {
             }
 
             case Tag::Return: {
-                auto res = loadSxp(Return::Cast(i)->arg<0>().val());
+                auto res = load(Return::Cast(i)->arg<0>().val(), unboxed.ret);
                 if (numLocals > 0)
                     decStack(numLocals);
                 builder.CreateRet(res);
@@ -4274,7 +4759,7 @@ bool LowerFunctionLLVM::tryCompile() {
                 auto f = Force::Cast(i);
                 auto arg = f->arg<0>().val();
                 if (!f->effects.includes(Effect::Force)) {
-                    if (!arg->type.maybePromiseWrapped()) {
+                    if (!maybePromiseWrapped(arg)) {
                         setVal(i, load(arg, representationOf(i)));
                     } else {
                         auto res = depromise(arg);
@@ -4472,8 +4957,9 @@ bool LowerFunctionLLVM::tryCompile() {
                         }
                     }
 
-                    llvm::Value* index =
-                        computeAndCheckIndex(extract->idx(), vector, fallback);
+                    llvm::Value* index = computeAndCheckIndex(
+                        extract->idx(), vector, fallback, nullptr,
+                        extract->inBounds);
                     auto res0 =
                         extract->vec()->type.isScalar()
                             ? vector
@@ -4602,8 +5088,9 @@ bool LowerFunctionLLVM::tryCompile() {
                         builder.SetInsertPoint(hit2);
                     }
 
-                    llvm::Value* index =
-                        computeAndCheckIndex(extract->idx(), vector, fallback);
+                    llvm::Value* index = computeAndCheckIndex(
+                        extract->idx(), vector, fallback, nullptr,
+                        extract->inBounds);
                     auto res0 =
                         extract->vec()->type.isScalar()
                             ? vector
@@ -5392,6 +5879,9 @@ bool LowerFunctionLLVM::tryCompile() {
     builder.SetInsertPoint(entryBlock);
     builder.CreateBr(getBlock(code->entry));
 
+    if (success && fun != boxedEntry)
+        compileBoxedEntry();
+
     if (success) {
         // outs() << "Compiled " << fun->getName() << "\n";
         // fun->dump();
@@ -5443,12 +5933,125 @@ bool LowerFunctionLLVM::tryCompile() {
 namespace rir {
 namespace pir {
 
+// Identifies the native code lowered from code, see PIR_NATIVE_CACHE. This is
+// the printed code, together with everything the lowering reads, but the
+// printer omits or abbreviates. Baseline code objects are identified by their
+// address (they are referenced by the deopt metadata), thus only compiling the
+// same closure twice yields the same key.
+static std::string
+cacheKey(ClosureVersion* cls, Code* code,
+         const std::unordered_map<Code*, std::pair<unsigned, MkEnv*>>& m,
+         const NeedsRefcountAdjustment& refcount,
+         const std::unordered_set<Instruction*>& needsLdVarForUpdate) {
+    std::stringstream key;
+    key << cls->context() << " nargs " << cls->nargs()
+        << (cls->properties.includes(ClosureVersion::Property::NoReflection)
+                ? " !refl"
+                : "");
+    // Promises access the (stub) environment of the closure directly
+    auto p = m.find(code);
+    if (p != m.end() && p->second.second) {
+        auto env = p->second.second;
+        key << " promise env ";
+        env->print(key, false);
+        key << (env->stub ? " stub" : "");
+    }
+    key << (code == cls ? " body" : " promise") << "\n";
+    code->printCode(key, false, false);
+
+    Visitor::run(code->entry, [&](Instruction* i) {
+        i->printRef(key);
+        key << " " << i->srcIdx;
+        auto& feedback = i->typeFeedback;
+        if (feedback.origin)
+            key << " feedback " << feedback.srcCode << "+"
+                << feedback.origin - feedback.srcCode->code() << " "
+                << feedback.type;
+        auto created = refcount.atCreation.find(i);
+        if (created != refcount.atCreation.end())
+            key << " refcount " << created->second;
+        auto used = refcount.beforeUse.find(i);
+        if (used != refcount.beforeUse.end()) {
+            for (auto u : used->second) {
+                key << " refcount ";
+                u.first->printRef(key);
+                key << " " << u.second;
+            }
+        }
+        if (needsLdVarForUpdate.count(i))
+            key << " ldVarForUpdate";
+
+        switch (i->tag) {
+        case Tag::LdConst:
+            key << " pool " << LdConst::Cast(i)->idx;
+            break;
+        case Tag::MkArg:
+            key << " promise " << m.at(MkArg::Cast(i)->prom()).first;
+            break;
+        case Tag::MkFunCls: {
+            auto mk = MkFunCls::Cast(i);
+            key << " " << mk->originalBody << " " << mk->cls->srcRef() << " "
+                << mk->cls->formals().original();
+            break;
+        }
+        case Tag::RecordDeoptReason: {
+            auto& reason = RecordDeoptReason::Cast(i)->reason;
+            key << " " << reason.reason << " " << reason.srcCode << "+"
+                << reason.originOffset;
+            break;
+        }
+        case Tag::StaticCall: {
+            // Depends on the dispatch table of the callee at this point
+            auto call = StaticCall::Cast(i);
+            auto target = call->tryDispatch();
+            size_t nargs = 0;
+            call->eachCallArg([&](Value*) { nargs++; });
+            key << " " << target->context() << " " << (target == cls) << " "
+                << target->properties.includes(
+                       ClosureVersion::Property::NoReflection)
+                << " " << UnboxedSignature(target).encode() << " "
+                << call->inferAvailableAssumptions().toI();
+            if (target->owner()->hasOriginClosure())
+                key << " " << target->owner()->rirClosure() << " "
+                    << call->cls()->rirClosure() << " "
+                    << nativeTargetOf(target, nargs);
+            break;
+        }
+        default:
+            break;
+        }
+        key << "\n";
+    });
+    return key.str();
+}
+
+bool LowerLLVM::recall(const std::string& key, rir::Code* target) {
+    JitLLVM::Compiled cached;
+    if (!JitLLVM::recall(key, target, cached))
+        return false;
+    // The samples of the profiler belong to the code object
+    pirTypeFeedback = cached.pirTypeFeedback
+                          ? cached.pirTypeFeedback->cloneLayout()
+                          : nullptr;
+    nativeCode = cached.nativeCode;
+    nativeCodeUnboxed = cached.nativeCodeUnboxed;
+    unboxedSignature = cached.unboxedSignature;
+    return true;
+}
+
 void* LowerLLVM::tryCompile(
     ClosureVersion* cls, Code* code,
     const std::unordered_map<Code*, std::pair<unsigned, MkEnv*>>& m,
     const NeedsRefcountAdjustment& refcount,
     const std::unordered_set<Instruction*>& needsLdVarForUpdate,
-    LogStream& log) {
+    LogStream& log, rir::Code* target) {
+
+    std::string key;
+    if (Parameter::PIR_NATIVE_CACHE) {
+        key = cacheKey(cls, code, m, refcount, needsLdVarForUpdate);
+        if (recall(key, target))
+            return nativeCode;
+    }
 
     JitLLVM::createModule();
     auto mangledName = JitLLVM::mangle(cls->name());
@@ -5457,7 +6060,82 @@ void* LowerLLVM::tryCompile(
     if (!funCompiler.tryCompile())
         return nullptr;
     pirTypeFeedback = funCompiler.pirTypeFeedback;
-    return JitLLVM::tryCompile(funCompiler.fun);
+    // Only function bodies count invocations and can thus get hot
+    nativeCode = JitLLVM::tryCompile(funCompiler.boxedEntry,
+                                     code == cls ? target : nullptr);
+    JitLLVM::attach(target);
+    unboxedSignature = funCompiler.unboxed.encode();
+    if (nativeCode && unboxedSignature)
+        nativeCodeUnboxed =
+            JitLLVM::lookup(JitLLVM::unboxedEntry(mangledName));
+    // Code of the fast tier is not shared, it would never be tiered up
+    if (nativeCode && !key.empty() &&
+        !target->flags.contains(rir::Code::NativeTierUp))
+        JitLLVM::remember(key, {nativeCode, nativeCodeUnboxed,
+                                unboxedSignature, pirTypeFeedback});
+    return nativeCode;
+}
+
+bool LowerLLVM::tryCompileAsync(
+    ClosureVersion* cls, Code* code,
+    const std::unordered_map<Code*, std::pair<unsigned, MkEnv*>>& m,
+    const NeedsRefcountAdjustment& refcount,
+    const std::unordered_set<Instruction*>& needsLdVarForUpdate,
+    LogStream& log, rir::Code* target) {
+
+    std::string key;
+    if (Parameter::PIR_NATIVE_CACHE) {
+        key = cacheKey(cls, code, m, refcount, needsLdVarForUpdate);
+        if (recall(key, target)) {
+            target->nativeCode = (NativeCode)nativeCode;
+            target->nativeCodeUnboxed = nativeCodeUnboxed;
+            target->unboxedSignature = unboxedSignature;
+            if (pirTypeFeedback)
+                target->pirTypeFeedback(pirTypeFeedback);
+            return true;
+        }
+    }
+
+    JitLLVM::createModule();
+    auto mangledName = JitLLVM::mangle(cls->name());
+    LowerFunctionLLVM funCompiler(mangledName, cls, code, m, refcount,
+                                  needsLdVarForUpdate, log);
+    if (!funCompiler.tryCompile())
+        return false;
+
+    // The generated code refers to both, they need to survive until the
+    // installer ran.
+    auto feedback = funCompiler.pirTypeFeedback;
+    R_PreserveObject(target->container());
+    if (feedback)
+        R_PreserveObject(feedback->container());
+
+    auto signature = funCompiler.unboxed.encode();
+    JitLLVM::tryCompileAsync(
+        funCompiler.boxedEntry,
+        [target, feedback, signature, mangledName, key](void* n) {
+            JitLLVM::attach(target);
+            if (n) {
+                target->nativeCode = (NativeCode)n;
+                target->unboxedSignature = signature;
+                if (signature)
+                    target->nativeCodeUnboxed =
+                        JitLLVM::lookup(JitLLVM::unboxedEntry(mangledName));
+                if (feedback)
+                    target->pirTypeFeedback(feedback);
+                if (!key.empty() &&
+                    !target->flags.contains(rir::Code::NativeTierUp))
+                    JitLLVM::remember(key, {n, target->nativeCodeUnboxed,
+                                            signature, feedback});
+            } else {
+                target->flags.reset(rir::Code::NativeTierUp);
+            }
+            if (feedback)
+                R_ReleaseObject(feedback->container());
+            R_ReleaseObject(target->container());
+        },
+        code == cls ? target : nullptr);
+    return true;
 }
 
 } // namespace pir
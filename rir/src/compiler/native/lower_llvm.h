@@ -4,6 +4,7 @@
 #include "../analysis/reference_count.h"
 #include "compiler/pir/pir.h"
 #include "runtime/Code.h"
+#include <string>
 #include <unordered_map>
 #include <unordered_set>
 #include <vector>
@@ -13,13 +14,34 @@ namespace pir {
 
 class LowerLLVM {
   public:
-    PirTypeFeedback* pirTypeFeedback;
+    void* nativeCode = nullptr;
+    PirTypeFeedback* pirTypeFeedback = nullptr;
+    // The unboxed entry point of the native code and its signature, see
+    // rir::Code::nativeCodeUnboxed
+    void* nativeCodeUnboxed = nullptr;
+    uint64_t unboxedSignature = 0;
+    // target is the code object receiving the native code
     void*
     tryCompile(ClosureVersion* cls, Code* code,
                const std::unordered_map<Code*, std::pair<unsigned, MkEnv*>>&,
                const NeedsRefcountAdjustment& refcount,
                const std::unordered_set<Instruction*>& needsLdVarForUpdate,
-               LogStream& log);
+               LogStream& log, rir::Code* target);
+
+    // Lowers to LLVM IR right away, but leaves machine code generation to the
+    // JIT worker thread. The native code (and its type feedback) are installed
+    // into target once ready. Returns false if lowering failed.
+    bool tryCompileAsync(
+        ClosureVersion* cls, Code* code,
+        const std::unordered_map<Code*, std::pair<unsigned, MkEnv*>>&,
+        const NeedsRefcountAdjustment& refcount,
+        const std::unordered_set<Instruction*>& needsLdVarForUpdate,
+        LogStream& log, rir::Code* target);
+
+  private:
+    // Reuses native code lowered from the same PIR before, see
+    // PIR_NATIVE_CACHE. Attaches it to target and fills in the fields above.
+    bool recall(const std::string& key, rir::Code* target);
 };
 
 } // namespace pir
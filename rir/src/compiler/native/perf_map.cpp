@@ -0,0 +1,180 @@
+#include "perf_map.h"
+
+#include "compiler/parameter.h"
+
+#include <cassert>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <elf.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace rir {
+namespace pir {
+
+// See tools/perf/Documentation/jitdump-specification.txt in the linux sources
+namespace jitdump {
+
+static constexpr uint32_t MAGIC = 0x4A695444;
+static constexpr uint32_t VERSION = 1;
+static constexpr uint32_t CODE_LOAD = 0;
+static constexpr uint32_t CODE_CLOSE = 3;
+
+struct Header {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t totalSize;
+    uint32_t elfMach;
+    uint32_t pad1;
+    uint32_t pid;
+    uint64_t timestamp;
+    uint64_t flags;
+};
+
+struct RecordHeader {
+    uint32_t id;
+    uint32_t totalSize;
+    uint64_t timestamp;
+};
+
+struct CodeLoad {
+    RecordHeader header;
+    uint32_t pid;
+    uint32_t tid;
+    uint64_t vma;
+    uint64_t codeAddress;
+    uint64_t codeSize;
+    uint64_t codeIndex;
+    // followed by the zero terminated name and the machine code
+};
+
+// perf record -k mono
+static uint64_t timestamp() {
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static uint32_t elfMachine() {
+#if defined(__x86_64__)
+    return EM_X86_64;
+#elif defined(__aarch64__)
+    return EM_AARCH64;
+#elif defined(__i386__)
+    return EM_386;
+#else
+    return EM_NONE;
+#endif
+}
+
+} // namespace jitdump
+
+class PerfMapWriter {
+    FILE* map = nullptr;
+    FILE* dump = nullptr;
+    void* dumpMarker = nullptr;
+    uint64_t codeIndex = 0;
+
+    void openDump() {
+        char name[64];
+        snprintf(name, sizeof(name), "/tmp/jit-%d.dump", getpid());
+        int fd = open(name, O_CREAT | O_TRUNC | O_RDWR, 0666);
+        if (fd == -1)
+            return;
+        // perf inject finds the file through this executable mapping of it
+        dumpMarker = mmap(nullptr, sysconf(_SC_PAGESIZE), PROT_READ | PROT_EXEC,
+                          MAP_PRIVATE, fd, 0);
+        if (dumpMarker == MAP_FAILED) {
+            dumpMarker = nullptr;
+            close(fd);
+            return;
+        }
+        dump = fdopen(fd, "w+");
+        if (!dump) {
+            close(fd);
+            return;
+        }
+
+        jitdump::Header header;
+        memset(&header, 0, sizeof(header));
+        header.magic = jitdump::MAGIC;
+        header.version = jitdump::VERSION;
+        header.totalSize = sizeof(header);
+        header.elfMach = jitdump::elfMachine();
+        header.pid = getpid();
+        header.timestamp = jitdump::timestamp();
+        fwrite(&header, sizeof(header), 1, dump);
+    }
+
+    void writeDump(const PerfMap::Symbol& s) {
+        jitdump::CodeLoad record;
+        record.header.id = jitdump::CODE_LOAD;
+        record.header.totalSize = sizeof(record) + s.name.size() + 1 + s.size;
+        record.header.timestamp = jitdump::timestamp();
+        record.pid = getpid();
+        record.tid = syscall(SYS_gettid);
+        record.vma = s.address;
+        record.codeAddress = s.address;
+        record.codeSize = s.size;
+        record.codeIndex = codeIndex++;
+        fwrite(&record, sizeof(record), 1, dump);
+        fwrite(s.name.c_str(), s.name.size() + 1, 1, dump);
+        fwrite((void*)s.address, s.size, 1, dump);
+    }
+
+  public:
+    PerfMapWriter() {
+        char name[64];
+        snprintf(name, sizeof(name), "/tmp/perf-%d.map", getpid());
+        map = fopen(name, "a");
+        if (Parameter::PIR_PERF_MAP > 1)
+            openDump();
+    }
+
+    ~PerfMapWriter() {
+        if (map)
+            fclose(map);
+        if (dump) {
+            jitdump::RecordHeader record;
+            record.id = jitdump::CODE_CLOSE;
+            record.totalSize = sizeof(record);
+            record.timestamp = jitdump::timestamp();
+            fwrite(&record, sizeof(record), 1, dump);
+            fclose(dump);
+        }
+        if (dumpMarker)
+            munmap(dumpMarker, sysconf(_SC_PAGESIZE));
+    }
+
+    void write(const std::vector<PerfMap::Symbol>& symbols) {
+        for (auto& s : symbols) {
+            if (map)
+                fprintf(map, "%lx %lx %s\n", (unsigned long)s.address,
+                        (unsigned long)s.size, s.name.c_str());
+            if (dump)
+                writeDump(s);
+        }
+        if (map)
+            fflush(map);
+        if (dump)
+            fflush(dump);
+    }
+};
+
+bool PerfMap::enabled() { return Parameter::PIR_PERF_MAP; }
+
+void PerfMap::write(const std::vector<Symbol>& symbols) {
+    assert(enabled());
+    static PerfMapWriter writer;
+    writer.write(symbols);
+}
+
+unsigned Parameter::PIR_PERF_MAP =
+    getenv("PIR_PERF_MAP") ? atoi(getenv("PIR_PERF_MAP")) : 0;
+
+} // namespace pir
+} // namespace rir
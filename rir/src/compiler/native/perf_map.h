@@ -0,0 +1,41 @@
+#ifndef RIR_COMPILER_PERF_MAP_H
+#define RIR_COMPILER_PERF_MAP_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace rir {
+namespace pir {
+
+/*
+ * Makes the native code visible to the Linux perf tool, see PIR_PERF_MAP.
+ *
+ * With PIR_PERF_MAP=1 every compiled function is appended to the perf map
+ * /tmp/perf-<pid>.map, which perf report picks up without further steps.
+ *
+ * With PIR_PERF_MAP=2 the functions are also written to the jitdump file
+ * /tmp/jit-<pid>.dump, together with their machine code and a timestamp.
+ * Record with `perf record -k mono` and run `perf inject --jit` on the
+ * result. Unlike the perf map this stays correct when the memory of released
+ * native code is reused, and allows perf annotate to disassemble the code.
+ *
+ * Only one thread writes at a time (the R thread or the JIT worker).
+ */
+struct PerfMap {
+    struct Symbol {
+        std::string name;
+        uint64_t address;
+        uint64_t size;
+    };
+
+    static bool enabled();
+
+    // The machine code must be final
+    static void write(const std::vector<Symbol>& symbols);
+};
+
+} // namespace pir
+} // namespace rir
+
+#endif
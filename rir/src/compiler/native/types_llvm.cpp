@@ -232,6 +232,11 @@ int initializeTypes(LLVMContext& context) {
     NativeBuiltins::notOp.llvmSignature = t::sexp_sexp;
     NativeBuiltins::binop.llvmSignature = t::sexp_sexpsexpint;
     NativeBuiltins::binopEnv.llvmSignature = t::sexp_sexp3int2;
+    NativeBuiltins::vectorExpr.llvmSignature =
+        llvm::FunctionType::get(t::SEXP, {t::IntPtr, t::i64, t::Int, t::i64},
+                                false);
+    NativeBuiltins::math1.llvmSignature =
+        llvm::FunctionType::get(t::SEXP, {t::SEXP, t::Int, t::Int}, false);
 
     NativeBuiltins::isMissing.llvmSignature = t::int_sexpsexp;
     NativeBuiltins::asTest.llvmSignature = t::int_sexp;
@@ -0,0 +1,419 @@
+#include "vector_kernels.h"
+#include "R/r.h"
+
+#include <algorithm>
+#include <cassert>
+#include <climits>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+namespace rir {
+namespace pir {
+
+static inline bool isNA(int v) { return v == NA_INTEGER; }
+static inline bool isNA(double) { return false; }
+
+static inline double toReal(int v) { return isNA(v) ? NA_REAL : (double)v; }
+static inline double toReal(double v) { return v; }
+
+// Applies op element-wise, recycling the shorter operand. The length of the
+// result is a multiple of both operand lengths, thus the shorter operand is
+// recycled in chunks, which keeps all the inner loops vectorizable.
+template <typename X, typename Y, typename R, typename Op>
+static void apply(const X* __restrict__ x, R_xlen_t nx,
+                  const Y* __restrict__ y, R_xlen_t ny, R* __restrict__ res,
+                  R_xlen_t n, const Op& op) {
+    if (nx == 1) {
+        auto a = x[0];
+        for (R_xlen_t i = 0; i < n; ++i)
+            res[i] = op(a, y[i]);
+    } else if (ny == 1) {
+        auto b = y[0];
+        for (R_xlen_t i = 0; i < n; ++i)
+            res[i] = op(x[i], b);
+    } else if (nx >= ny) {
+        for (R_xlen_t c = 0; c < n; c += ny)
+            for (R_xlen_t i = 0; i < ny; ++i)
+                res[c + i] = op(x[c + i], y[i]);
+    } else {
+        for (R_xlen_t c = 0; c < n; c += nx)
+            for (R_xlen_t i = 0; i < nx; ++i)
+                res[c + i] = op(x[i], y[c + i]);
+    }
+}
+
+template <typename R, typename Op>
+static void apply(SEXP lhs, SEXP rhs, R* res, R_xlen_t n, const Op& op) {
+    auto nx = XLENGTH(lhs);
+    auto ny = XLENGTH(rhs);
+    if (TYPEOF(lhs) == INTSXP) {
+        if (TYPEOF(rhs) == INTSXP)
+            apply(INTEGER(lhs), nx, INTEGER(rhs), ny, res, n, op);
+        else
+            apply(INTEGER(lhs), nx, REAL(rhs), ny, res, n, op);
+    } else {
+        if (TYPEOF(rhs) == INTSXP)
+            apply(REAL(lhs), nx, INTEGER(rhs), ny, res, n, op);
+        else
+            apply(REAL(lhs), nx, REAL(rhs), ny, res, n, op);
+    }
+}
+
+// Integer +, - and *. Results outside of the int range are NA (R_INT_MIN is
+// -INT_MAX), with a warning.
+template <typename Op>
+static SEXP intArith(SEXP call, SEXP lhs, SEXP rhs, R_xlen_t n, const Op& op) {
+    // Accessing the data of ALTREP operands (e.g. compact sequences) allocates
+    SEXP res = PROTECT(Rf_allocVector(INTSXP, n));
+    int overflow = 0;
+    apply(lhs, rhs, INTEGER(res), n, [&](int a, int b) {
+        int64_t r = op((int64_t)a, (int64_t)b);
+        bool na = isNA(a) || isNA(b);
+        bool out = r > INT_MAX || r < -INT_MAX;
+        overflow |= !na && out;
+        return na || out ? NA_INTEGER : (int)r;
+    });
+    if (overflow)
+        Rf_warningcall(call, "NAs produced by integer overflow");
+    UNPROTECT(1);
+    return res;
+}
+
+template <typename Op>
+static SEXP realArith(SEXP lhs, SEXP rhs, R_xlen_t n, const Op& op) {
+    SEXP res = PROTECT(Rf_allocVector(REALSXP, n));
+    apply(lhs, rhs, REAL(res), n, [&](auto a, auto b) {
+        return isNA(a) || isNA(b) ? NA_REAL : op((double)a, (double)b);
+    });
+    UNPROTECT(1);
+    return res;
+}
+
+// Integers are compared as doubles, which is exact, and maps NA to NaN
+template <typename Op>
+static SEXP relop(SEXP lhs, SEXP rhs, R_xlen_t n, const Op& op) {
+    SEXP res = PROTECT(Rf_allocVector(LGLSXP, n));
+    apply(lhs, rhs, LOGICAL(res), n, [&](auto a, auto b) {
+        double x = toReal(a);
+        double y = toReal(b);
+        return ISNAN(x) || ISNAN(y) ? NA_LOGICAL : (int)op(x, y);
+    });
+    UNPROTECT(1);
+    return res;
+}
+
+SEXP tryVectorBinop(SEXP call, SEXP lhs, SEXP rhs, BinopKind kind) {
+    auto tl = TYPEOF(lhs);
+    auto tr = TYPEOF(rhs);
+    if ((tl != INTSXP && tl != REALSXP) || (tr != INTSXP && tr != REALSXP))
+        return nullptr;
+    // Attributes would have to be copied to the result (or dispatched on)
+    if (ATTRIB(lhs) != R_NilValue || ATTRIB(rhs) != R_NilValue)
+        return nullptr;
+    auto nx = XLENGTH(lhs);
+    auto ny = XLENGTH(rhs);
+    if (nx == 0 || ny == 0)
+        return nullptr;
+    auto n = std::max(nx, ny);
+    // R warns if the longer length is not a multiple of the shorter one
+    if (n % nx != 0 || n % ny != 0)
+        return nullptr;
+
+    bool ints = tl == INTSXP && tr == INTSXP;
+    switch (kind) {
+    case BinopKind::ADD:
+        if (ints)
+            return intArith(call, lhs, rhs, n,
+                            [](int64_t a, int64_t b) { return a + b; });
+        return realArith(lhs, rhs, n,
+                         [](double a, double b) { return a + b; });
+    case BinopKind::SUB:
+        if (ints)
+            return intArith(call, lhs, rhs, n,
+                            [](int64_t a, int64_t b) { return a - b; });
+        return realArith(lhs, rhs, n,
+                         [](double a, double b) { return a - b; });
+    case BinopKind::MUL:
+        if (ints)
+            return intArith(call, lhs, rhs, n,
+                            [](int64_t a, int64_t b) { return a * b; });
+        return realArith(lhs, rhs, n,
+                         [](double a, double b) { return a * b; });
+    case BinopKind::DIV:
+        return realArith(lhs, rhs, n,
+                         [](double a, double b) { return a / b; });
+    case BinopKind::EQ:
+        return relop(lhs, rhs, n, [](double a, double b) { return a == b; });
+    case BinopKind::NE:
+        return relop(lhs, rhs, n, [](double a, double b) { return a != b; });
+    case BinopKind::LT:
+        return relop(lhs, rhs, n, [](double a, double b) { return a < b; });
+    case BinopKind::LTE:
+        return relop(lhs, rhs, n, [](double a, double b) { return a <= b; });
+    case BinopKind::GT:
+        return relop(lhs, rhs, n, [](double a, double b) { return a > b; });
+    case BinopKind::GTE:
+        return relop(lhs, rhs, n, [](double a, double b) { return a >= b; });
+    default:
+        return nullptr;
+    }
+}
+
+// Number of elements of every operand held in the scratch buffers at a time.
+// Small enough for the buffers of a few nodes to stay in the L1 cache.
+static constexpr R_xlen_t ExprChunk = 256;
+
+namespace {
+// A node of the expression, evaluated for the current chunk
+struct Operand {
+    bool isInt;
+    const int* i;
+    const double* d;
+};
+} // namespace
+
+template <typename Op>
+static int intChunk(const int* x, const int* y, int* res, R_xlen_t m,
+                    const Op& op) {
+    int overflow = 0;
+    for (R_xlen_t i = 0; i < m; ++i) {
+        int64_t r = op((int64_t)x[i], (int64_t)y[i]);
+        bool na = isNA(x[i]) || isNA(y[i]);
+        bool out = r > INT_MAX || r < -INT_MAX;
+        overflow |= !na && out;
+        res[i] = na || out ? NA_INTEGER : (int)r;
+    }
+    return overflow;
+}
+
+template <typename Op>
+static void realChunk(const double* x, const double* y, double* res,
+                      R_xlen_t m, const Op& op) {
+    for (R_xlen_t i = 0; i < m; ++i)
+        res[i] = op(x[i], y[i]);
+}
+
+static int intChunk(BinopKind kind, const int* x, const int* y, int* res,
+                    R_xlen_t m) {
+    switch (kind) {
+    case BinopKind::ADD:
+        return intChunk(x, y, res, m,
+                        [](int64_t a, int64_t b) { return a + b; });
+    case BinopKind::SUB:
+        return intChunk(x, y, res, m,
+                        [](int64_t a, int64_t b) { return a - b; });
+    case BinopKind::MUL:
+        return intChunk(x, y, res, m,
+                        [](int64_t a, int64_t b) { return a * b; });
+    default:
+        assert(false);
+        return 0;
+    }
+}
+
+static void realChunk(BinopKind kind, const double* x, const double* y,
+                      double* res, R_xlen_t m) {
+    switch (kind) {
+    case BinopKind::ADD:
+        realChunk(x, y, res, m, [](double a, double b) { return a + b; });
+        break;
+    case BinopKind::SUB:
+        realChunk(x, y, res, m, [](double a, double b) { return a - b; });
+        break;
+    case BinopKind::MUL:
+        realChunk(x, y, res, m, [](double a, double b) { return a * b; });
+        break;
+    case BinopKind::DIV:
+        realChunk(x, y, res, m, [](double a, double b) { return a / b; });
+        break;
+    default:
+        assert(false);
+    }
+}
+
+static const double* toRealChunk(const int* x, double* res, R_xlen_t m) {
+    for (R_xlen_t i = 0; i < m; ++i)
+        res[i] = toReal(x[i]);
+    return res;
+}
+
+SEXP tryVectorExpr(SEXP call, const int* program, size_t length,
+                   const SEXP* args, size_t nargs) {
+    if (length == 0 || program[length - 1] == VectorExprArg)
+        return nullptr;
+
+    R_xlen_t n = 0;
+    for (size_t a = 0; a < nargs; ++a) {
+        auto t = TYPEOF(args[a]);
+        if ((t != INTSXP && t != REALSXP) || ATTRIB(args[a]) != R_NilValue)
+            return nullptr;
+        n = std::max(n, XLENGTH(args[a]));
+    }
+    if (n == 0)
+        return nullptr;
+    // Scalars are broadcast, recycling of other lengths is left to the
+    // generic implementation
+    for (size_t a = 0; a < nargs; ++a) {
+        auto l = XLENGTH(args[a]);
+        if (l != n && l != 1)
+            return nullptr;
+    }
+
+    // The result type of every node and the depth of the evaluation stack
+    std::vector<bool> isInt(length);
+    size_t depth = 0;
+    {
+        std::vector<bool> stack;
+        size_t a = 0;
+        for (size_t p = 0; p < length; ++p) {
+            if (program[p] == VectorExprArg) {
+                if (a == nargs)
+                    return nullptr;
+                isInt[p] = TYPEOF(args[a++]) == INTSXP;
+            } else {
+                if (stack.size() < 2)
+                    return nullptr;
+                bool y = stack.back();
+                stack.pop_back();
+                bool x = stack.back();
+                stack.pop_back();
+                switch ((BinopKind)program[p]) {
+                case BinopKind::ADD:
+                case BinopKind::SUB:
+                case BinopKind::MUL:
+                    isInt[p] = x && y;
+                    break;
+                case BinopKind::DIV:
+                    isInt[p] = false;
+                    break;
+                default:
+                    return nullptr;
+                }
+            }
+            stack.push_back(isInt[p]);
+            depth = std::max(depth, stack.size());
+        }
+        if (a != nargs || stack.size() != 1)
+            return nullptr;
+    }
+
+    // Every stack slot owns a chunk of scratch space, nodes are evaluated into
+    // the slot of their left operand
+    std::vector<int> ibuf(depth * ExprChunk);
+    std::vector<double> dbuf(depth * ExprChunk);
+    std::vector<Operand> stack;
+    stack.reserve(depth);
+
+    // Accessing the data of ALTREP operands allocates
+    SEXP res =
+        PROTECT(Rf_allocVector(isInt[length - 1] ? INTSXP : REALSXP, n));
+    int overflow = 0;
+    for (R_xlen_t c = 0; c < n; c += ExprChunk) {
+        auto m = std::min(ExprChunk, n - c);
+        size_t a = 0;
+        stack.clear();
+        for (size_t p = 0; p < length; ++p) {
+            if (program[p] == VectorExprArg) {
+                SEXP arg = args[a++];
+                auto slot = stack.size() * ExprChunk;
+                if (TYPEOF(arg) == INTSXP) {
+                    const int* x = INTEGER(arg);
+                    if (XLENGTH(arg) == 1)
+                        x = std::fill_n(&ibuf[slot], m, x[0]) - m;
+                    else
+                        x += c;
+                    stack.push_back({true, x, nullptr});
+                } else {
+                    const double* x = REAL(arg);
+                    if (XLENGTH(arg) == 1)
+                        x = std::fill_n(&dbuf[slot], m, x[0]) - m;
+                    else
+                        x += c;
+                    stack.push_back({false, nullptr, x});
+                }
+                continue;
+            }
+
+            auto y = stack.back();
+            stack.pop_back();
+            auto x = stack.back();
+            stack.pop_back();
+            auto slot = stack.size() * ExprChunk;
+            bool root = p == length - 1;
+            auto kind = (BinopKind)program[p];
+            if (isInt[p]) {
+                int* out = root ? INTEGER(res) + c : &ibuf[slot];
+                overflow |= intChunk(kind, x.i, y.i, out, m);
+                stack.push_back({true, out, nullptr});
+            } else {
+                auto xd = x.isInt ? toRealChunk(x.i, &dbuf[slot], m) : x.d;
+                auto yd = y.isInt ? toRealChunk(y.i, &dbuf[slot + ExprChunk], m)
+                                  : y.d;
+                double* out = root ? REAL(res) + c : &dbuf[slot];
+                realChunk(kind, xd, yd, out, m);
+                stack.push_back({false, nullptr, out});
+            }
+        }
+    }
+    if (overflow)
+        Rf_warningcall(call, "NAs produced by integer overflow");
+    UNPROTECT(1);
+    return res;
+}
+
+template <typename X, typename Op>
+static bool math1(const X* __restrict__ x, double* __restrict__ res,
+                  R_xlen_t n, const Op& op) {
+    bool nans = false;
+    for (R_xlen_t i = 0; i < n; ++i) {
+        double a = toReal(x[i]);
+        double r = op(a);
+        nans |= std::isnan(r) && !std::isnan(a);
+        res[i] = std::isnan(a) ? a : r;
+    }
+    return nans;
+}
+
+template <typename Op>
+static SEXP math1(SEXP call, SEXP x, const Op& op) {
+    auto n = XLENGTH(x);
+    // Accessing the data of ALTREP operands allocates
+    SEXP res = PROTECT(Rf_allocVector(REALSXP, n));
+    bool nans = TYPEOF(x) == REALSXP ? math1(REAL(x), REAL(res), n, op)
+                                     : math1(INTEGER(x), REAL(res), n, op);
+    if (nans)
+        Rf_warningcall(call, "NaNs produced");
+    UNPROTECT(1);
+    return res;
+}
+
+SEXP tryVectorMath1(SEXP call, SEXP x, Math1Kind kind) {
+    if (ATTRIB(x) != R_NilValue)
+        return nullptr;
+    if (TYPEOF(x) != LGLSXP && TYPEOF(x) != INTSXP && TYPEOF(x) != REALSXP)
+        return nullptr;
+
+    switch (kind) {
+    case Math1Kind::SQRT:
+        return math1(call, x, [](double a) { return std::sqrt(a); });
+    case Math1Kind::EXP:
+        return math1(call, x, [](double a) { return std::exp(a); });
+    case Math1Kind::FLOOR:
+        return math1(call, x, [](double a) { return std::floor(a); });
+    case Math1Kind::CEILING:
+        return math1(call, x, [](double a) { return std::ceil(a); });
+    case Math1Kind::SIN:
+        return math1(call, x, [](double a) { return std::sin(a); });
+    case Math1Kind::COS:
+        return math1(call, x, [](double a) { return std::cos(a); });
+    case Math1Kind::LOG2:
+        return math1(call, x, [](double a) { return std::log2(a); });
+    case Math1Kind::LOG10:
+        return math1(call, x, [](double a) { return std::log10(a); });
+    }
+    return nullptr;
+}
+
+} // namespace pir
+} // namespace rir
@@ -0,0 +1,39 @@
+#ifndef PIR_NATIVE_VECTOR_KERNELS
+#define PIR_NATIVE_VECTOR_KERNELS
+
+#include "R/r_incl.h"
+#include "builtins.h"
+
+namespace rir {
+namespace pir {
+
+// Element-wise arithmetic and comparison of plain (no attributes) integer and
+// double vectors, with R's NA and recycling semantics. Returns nullptr if the
+// operands or the operation are not supported, in which case the caller has
+// to fall back to the generic R implementation. The loops are compiled with
+// auto-vectorization enabled.
+SEXP tryVectorBinop(SEXP call, SEXP lhs, SEXP rhs, BinopKind kind);
+
+// Marks a leaf in the program of a fused vector expression. The program is
+// the postfix order of the expression tree, inner nodes are BinopKinds and
+// every leaf refers to the next argument.
+static constexpr int VectorExprArg = -1;
+
+// Evaluates a fused expression of +, -, * and / on plain integer and double
+// vectors in one pass over chunks of the operands, without allocating the
+// intermediate vectors. Only operands of the full length or scalars are
+// supported. Returns nullptr otherwise, in which case the caller has to
+// evaluate the nodes one by one.
+SEXP tryVectorExpr(SEXP call, const int* program, size_t length,
+                   const SEXP* args, size_t nargs);
+
+// Applies one of the math1 builtins (sqrt, exp, floor, ...) element-wise to a
+// plain logical, integer or double vector. The result is a double vector, NA
+// and NaN elements are passed through. Returns nullptr for operands with
+// attributes or of other types.
+SEXP tryVectorMath1(SEXP call, SEXP x, Math1Kind kind);
+
+} // namespace pir
+} // namespace rir
+
+#endif
@@ -2,7 +2,7 @@
 #include "../analysis/dead.h"
 #include "../pir/pir_impl.h"
 #include "../util/visitor.h"
-#include "compiler/analysis/cfg.h"
+#include "compiler/analysis/analysis_cache.h"
 
 #include "R/r.h"
 #include "pass_definitions.h"
@@ -175,7 +175,7 @@ bool OptimizeAssumptions::apply(Compiler&, ClosureVersion* vers, Code* code,
 
     AvailableCheckpoints checkpoint(vers, code, log);
     AvailableAssumptions assumptions(vers, code, log);
-    DominanceGraph dom(code);
+    auto& dom = code->analyses().dominanceGraph();
     std::unordered_map<Checkpoint*, Checkpoint*> replaced;
 
     std::unordered_map<Instruction*,
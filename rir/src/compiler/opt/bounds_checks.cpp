@@ -0,0 +1,121 @@
+#include "../analysis/range.h"
+#include "../pir/pir_impl.h"
+#include "../util/visitor.h"
+#include "R/BuiltinIds.h"
+#include "compiler/analysis/analysis_cache.h"
+#include "pass_definitions.h"
+
+namespace rir {
+namespace pir {
+
+// Is len the length of vec, i.e. length(vec) or length(seq_along(vec))?
+static bool isLengthOf(Value* len, Value* vec) {
+    len = len->followCasts();
+    Value* of = nullptr;
+    if (auto l = XLength::Cast(len))
+        of = l->arg(0).val()->followCasts();
+    else if (auto l = ForSeqSize::Cast(len))
+        of = l->arg(0).val()->followCasts();
+    if (!of)
+        return false;
+    if (of == vec)
+        return true;
+    if (auto b = CallSafeBuiltin::Cast(of))
+        return b->builtinId == blt("seq_along") && b->nCallArgs() == 1 &&
+               b->callArg(0).val()->followCasts() == vec;
+    if (auto b = CallBuiltin::Cast(of))
+        return b->builtinId == blt("seq_along") && b->nCallArgs() == 1 &&
+               b->callArg(0).val()->followCasts() == vec;
+    return false;
+}
+
+// Does taking the `holds` side of the branch on cond imply idx <= length(vec)?
+static bool impliesInBounds(Value* cond, bool holds, Value* idx, Value* vec) {
+    cond = cond->followCasts();
+    // Without AsTest an NA condition takes the false branch
+    bool naTakesFalse = true;
+    if (auto t = AsTest::Cast(cond)) {
+        cond = t->arg(0).val()->followCasts();
+        naTakesFalse = false;
+    }
+    if (auto l = AsLogical::Cast(cond))
+        cond = l->arg(0).val()->followCasts();
+    if (auto n = Not::Cast(cond)) {
+        cond = n->arg(0).val()->followCasts();
+        holds = !holds;
+    }
+
+    auto i = Instruction::Cast(cond);
+    if (!i || (!Lt::Cast(i) && !Lte::Cast(i) && !Gt::Cast(i) && !Gte::Cast(i)))
+        return false;
+    auto l = i->arg(0).val();
+    auto r = i->arg(1).val();
+    // A false comparison only tells us something, if it did not involve NA
+    if (!holds && naTakesFalse &&
+        (l->type.maybeNAOrNaN() || r->type.maybeNAOrNaN()))
+        return false;
+
+    // Normalize to small <= big (or small < big)
+    bool leftIsSmall = (Lt::Cast(i) || Lte::Cast(i)) == holds;
+    auto small = leftIsSmall ? l : r;
+    auto big = leftIsSmall ? r : l;
+    return small == idx && isLengthOf(big, vec);
+}
+
+// Is bb only reached through a branch, which ensures idx <= length(vec)?
+static bool belowLength(BB* bb, Value* idx, Value* vec,
+                        const DominanceGraph& dom) {
+    while (true) {
+        if (bb->predecessors().size() == 1) {
+            auto pred = *bb->predecessors().begin();
+            auto branch =
+                pred->isEmpty() ? nullptr : Branch::Cast(pred->last());
+            if (branch && pred->trueBranch() != pred->falseBranch() &&
+                impliesInBounds(branch->arg(0).val(),
+                                pred->trueBranch() == bb, idx, vec))
+                return true;
+        }
+        if (!dom.hasImmediateDominator(bb))
+            return false;
+        bb = dom.immediateDominator(bb);
+    }
+}
+
+bool BoundsChecks::apply(Compiler&, ClosureVersion* cls, Code* code,
+                         LogStream& log) const {
+    bool anyChange = false;
+    auto& dom = code->analyses().dominanceGraph();
+    RangeAnalysis ranges(cls, code, log);
+
+    auto check = [&](BB* bb, Instruction* e, Value* vec, Value* idx) {
+        if (!idx->type.isScalar())
+            return false;
+        // The range only covers the non-NA values, the NA check stays
+        auto state = ranges.before(e);
+        auto r = state.range.find(idx);
+        if (r == state.range.end() || r->second.first < 1)
+            return false;
+        return belowLength(bb, idx, vec->followCasts(), dom);
+    };
+
+    Visitor::run(code->entry, [&](BB* bb) {
+        for (auto i : *bb) {
+            if (auto e = Extract1_1D::Cast(i)) {
+                if (!e->inBounds && check(bb, e, e->vec(), e->idx())) {
+                    e->inBounds = true;
+                    anyChange = true;
+                }
+            } else if (auto e = Extract2_1D::Cast(i)) {
+                if (!e->inBounds && check(bb, e, e->vec(), e->idx())) {
+                    e->inBounds = true;
+                    anyChange = true;
+                }
+            }
+        }
+    });
+
+    return anyChange;
+}
+
+} // namespace pir
+} // namespace rir
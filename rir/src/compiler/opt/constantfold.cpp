@@ -5,7 +5,7 @@
 #include "R/Funtab.h"
 #include "R/Symbols.h"
 #include "R/r.h"
-#include "compiler/analysis/cfg.h"
+#include "compiler/analysis/analysis_cache.h"
 #include "compiler/compiler.h"
 #include "interpreter/interp.h"
 #include "pass_definitions.h"
@@ -108,8 +108,8 @@ bool Constantfold::apply(Compiler& cmp, ClosureVersion* cls, Code* code,
 
     std::unordered_map<BB*, bool> branchRemoval;
 
-    DominanceGraph dom(code);
-    DominanceFrontier dfront(code, dom);
+    auto& dom = code->analyses().dominanceGraph();
+    auto& dfront = code->analyses().dominanceFrontier();
     {
         // Branch Elimination
         //
@@ -1,6 +1,6 @@
 #include "../pir/pir_impl.h"
 #include "../util/visitor.h"
-#include "compiler/analysis/cfg.h"
+#include "compiler/analysis/analysis_cache.h"
 #include "pass_definitions.h"
 
 namespace rir {
@@ -21,8 +21,8 @@ bool DelayInstr::apply(Compiler&, ClosureVersion* cls, Code* code,
     std::unordered_map<Instruction*, SmallSet<BB*>> usedOnlyInDeopt;
     std::unordered_map<Instruction*, SmallSet<Instruction*>> updatePromises;
     std::unordered_map<Instruction*, SmallSet<BB*>> udatePromiseTargets;
-    const DominanceGraph dom(code);
-    const CFG cfg(code);
+    auto& dom = code->analyses().dominanceGraph();
+    auto& cfg = code->analyses().cfg();
     bool changed = true;
 
     while (changed) {
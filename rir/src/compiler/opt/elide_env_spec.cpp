@@ -2,7 +2,7 @@
 #include "../pir/pir_impl.h"
 #include "../util/visitor.h"
 #include "R/r.h"
-#include "compiler/analysis/cfg.h"
+#include "compiler/analysis/analysis_cache.h"
 #include "compiler/util/bb_transform.h"
 #include "compiler/util/safe_builtins_list.h"
 #include "interpreter/builtins.h"
@@ -19,7 +19,7 @@ bool ElideEnvSpec::apply(Compiler&, ClosureVersion* cls, Code* code,
 
     constexpr bool debug = false;
     AvailableCheckpoints checkpoint(cls, code, log);
-    DominanceGraph dom(code);
+    auto& dom = code->analyses().dominanceGraph();
 
     auto envOnlyForObj = [&](Instruction* i) {
         if (i->envOnlyForObj())
@@ -1,4 +1,5 @@
 #include "R/r.h"
+#include "compiler/analysis/analysis_cache.h"
 #include "compiler/pir/pir.h"
 #include "compiler/pir/pir_impl.h"
 #include "compiler/util/bb_transform.h"
@@ -170,7 +171,7 @@ bool GVN::apply(Compiler&, ClosureVersion* cls, Code* code,
     }
 
     {
-        DominanceGraph dom(code);
+        auto& dom = code->analyses().dominanceGraph();
 
         typedef std::set<std::pair<size_t, size_t>> PhiClass;
         auto computePhiClass = [&](Phi* phi, PhiClass& res) -> bool {
@@ -3,7 +3,7 @@
 #include "R/Funtab.h"
 #include "R/Symbols.h"
 #include "R/r.h"
-#include "compiler/analysis/cfg.h"
+#include "compiler/analysis/analysis_cache.h"
 #include "pass_definitions.h"
 
 #include <unordered_set>
@@ -14,7 +14,7 @@ namespace pir {
 bool HoistInstruction::apply(Compiler& cmp, ClosureVersion* cls, Code* code,
                              LogStream&) const {
     bool anyChange = false;
-    DominanceGraph dom(code);
+    auto& dom = code->analyses().dominanceGraph();
 
     VisitorNoDeoptBranch::run(code->entry, [&](BB* bb) {
         if (bb->isEmpty())
@@ -9,7 +9,9 @@
 #include "compiler/parameter.h"
 #include "compiler/util/bb_transform.h"
 #include "compiler/util/visitor.h"
+#include "interpreter/profiler.h"
 #include "pass_definitions.h"
+#include "runtime/DispatchTable.h"
 #include "utils/Pool.h"
 
 #include <algorithm>
@@ -194,6 +196,18 @@ bool Inline::apply(Compiler&, ClosureVersion* cls, Code* code,
                             weight *= 0.2;
                     }
                 }
+                // Callees the sampling profiler often finds on the stack are
+                // worth inlining
+                if (inlineeCls->hasOriginClosure()) {
+                    auto dt = DispatchTable::unpack(
+                        BODY(inlineeCls->rirClosure()));
+                    auto epoch = RuntimeProfiler::epoch();
+                    size_t samples = 0;
+                    for (size_t i = 0; i < dt->size(); ++i)
+                        samples += dt->get(i)->body()->recentSamples(epoch);
+                    if (samples >= Parameter::INLINER_HOT_SAMPLES)
+                        weight *= 0.5;
+                }
 
                 // No recursive inlining
                 if (inlinee->owner() == cls->owner()) {
@@ -445,6 +459,10 @@ size_t Parameter::INLINER_INITIAL_FUEL =
     getenv("PIR_INLINER_INITIAL_FUEL")
         ? atoi(getenv("PIR_INLINER_INITIAL_FUEL"))
         : 15;
+size_t Parameter::INLINER_HOT_SAMPLES =
+    getenv("PIR_INLINER_HOT_SAMPLES")
+        ? atoi(getenv("PIR_INLINER_HOT_SAMPLES"))
+        : 10;
 size_t Parameter::INLINER_INLINE_UNLIKELY =
     getenv("PIR_INLINER_INLINE_UNLIKELY")
         ? atoi(getenv("PIR_INLINER_INLINE_UNLIKELY"))
@@ -1,7 +1,7 @@
 #include "../analysis/loop_detection.h"
 #include "../pir/pir_impl.h"
 #include "../util/safe_builtins_list.h"
-#include "compiler/analysis/cfg.h"
+#include "compiler/analysis/analysis_cache.h"
 #include "pass_definitions.h"
 #include <unordered_map>
 
@@ -86,7 +86,8 @@ static bool loopOverwritesBinding(LoopDetection::Loop& loop, Value* origin,
 }
 
 static bool replaceWithOuterLoopEquivalent(Instruction* instruction,
-                                           DominanceGraph& dom, BB* start) {
+                                           const DominanceGraph& dom,
+                                           BB* start) {
     std::vector<Instruction*> betweenLoadandLoop;
     Instruction* found = nullptr;
     auto current = start;
@@ -144,7 +145,7 @@ static bool replaceWithOuterLoopEquivalent(Instruction* instruction,
 
 bool LoopInvariant::apply(Compiler&, ClosureVersion* cls, Code* code,
                           LogStream& log) const {
-    LoopDetection loops(code);
+    auto& loops = code->analyses().loops();
     bool anyChange = false;
 
     for (auto& loop : loops) {
@@ -180,7 +181,7 @@ bool LoopInvariant::apply(Compiler&, ClosureVersion* cls, Code* code,
         }
 
         if (safeToHoist) {
-            DominanceGraph dom(code);
+            auto& dom = code->analyses().dominanceGraph();
             for (auto loadAndBB : loads) {
                 auto load = loadAndBB.first;
                 auto bb = loadAndBB.second;
@@ -1,4 +1,5 @@
 #include "compiler/analysis/cfg.h"
+#include "compiler/analysis/range.h"
 #include "compiler/pir/pir_impl.h"
 #include "compiler/util/visitor.h"
 #include "pass_definitions.h"
@@ -7,9 +8,48 @@
 namespace rir {
 namespace pir {
 
+// The exact bounds of an integer binop, which overflows iff they exceed the
+// non-NA integers
+static bool fitsInt(Instruction* instr, const Range& a, const Range& b) {
+    int64_t lo, hi;
+    switch (instr->tag) {
+    case Tag::Add:
+        lo = (int64_t)a.first + b.first;
+        hi = (int64_t)a.second + b.second;
+        break;
+    case Tag::Sub:
+        lo = (int64_t)a.first - b.second;
+        hi = (int64_t)a.second - b.first;
+        break;
+    case Tag::Mul: {
+        int64_t p[] = {(int64_t)a.first * b.first, (int64_t)a.first * b.second,
+                       (int64_t)a.second * b.first,
+                       (int64_t)a.second * b.second};
+        lo = *std::min_element(p, p + 4);
+        hi = *std::max_element(p, p + 4);
+        break;
+    }
+    default:
+        return false;
+    }
+    return lo >= MIN && hi <= MAX;
+}
+
 bool Overflow::apply(Compiler&, ClosureVersion* cls, Code* code,
-                     LogStream&) const {
+                     LogStream& log) const {
     UsesTree uses(code);
+    RangeAnalysis ranges(cls, code, log);
+
+    auto rangeFits = [&](Instruction* instr) {
+        auto a = instr->arg(0).val();
+        auto b = instr->arg(1).val();
+        if (!RangeAnalysis::isInt(a) || !RangeAnalysis::isInt(b))
+            return false;
+        auto state = ranges.before(instr);
+        if (!state.range.count(a) || !state.range.count(b))
+            return false;
+        return fitsInt(instr, state.range.at(a), state.range.at(b));
+    };
 
     auto willDefinitelyNotOverflow = [&](Instruction* instr) {
         assert(Add::Cast(instr) || Sub::Cast(instr));
@@ -65,7 +105,7 @@ bool Overflow::apply(Compiler&, ClosureVersion* cls, Code* code,
     // integer. Here, we find these binop instructions, check if they won't
     // overflow / underflow, and if so refine the result type to non-NA.
     Visitor::run(code->entry, [&](Instruction* instr) {
-        if (!Add::Cast(instr) && !Sub::Cast(instr))
+        if (!Add::Cast(instr) && !Sub::Cast(instr) && !Mul::Cast(instr))
             return;
         // is a binop which we can infer may not overflow / underflow
         if (!instr->allNonEnvArgs([&](Value* arg) {
@@ -82,7 +122,8 @@ bool Overflow::apply(Compiler&, ClosureVersion* cls, Code* code,
         if (!instr->type.maybeNAOrNaN())
             return;
         // didn't already infer that it's non-NA
-        if (!willDefinitelyNotOverflow(instr))
+        if (!rangeFits(instr) &&
+            (Mul::Cast(instr) || !willDefinitelyNotOverflow(instr)))
             return;
         // will definitely not overflow / underflow
         // so we set the result type to non-NA
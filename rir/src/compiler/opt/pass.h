@@ -22,6 +22,11 @@ class Pass {
     std::string getName() const { return this->name; }
     virtual ~Pass() {}
     virtual bool isPhaseMarker() const { return false; }
+    // Passes which only touch the version they are applied to, i.e. never
+    // allocate on the R heap, insert into the constant pool or compile other
+    // closures, can run on several versions in parallel (see
+    // PIR_OPT_THREADS).
+    virtual bool isThreadSafe() const { return false; }
     virtual unsigned cost() const { return 1; }
 
   protected:
@@ -9,7 +9,7 @@ namespace pir {
 class LogStream;
 class Closure;
 
-#define PASS(name, __runOnPromises__)                                          \
+#define PASS_IMPL(name, __runOnPromises__, __threadSafe__)                    \
     name:                                                                      \
   public                                                                       \
     Pass {                                                                     \
@@ -20,8 +20,16 @@ class Closure;
         bool runOnPromises() const final override {                            \
             return __runOnPromises__;                                          \
         }                                                                      \
+        bool isThreadSafe() const final override { return __threadSafe__; }    \
     };
 
+#define PASS(name, __runOnPromises__) PASS_IMPL(name, __runOnPromises__, false)
+
+// A pass which can be applied to several versions in parallel, see
+// Pass::isThreadSafe
+#define PARALLEL_PASS(name, __runOnPromises__)                                 \
+    PASS_IMPL(name, __runOnPromises__, true)
+
 /*
  * Uses scope analysis to get rid of as many `LdVar`'s as possible.
  *
@@ -39,7 +47,7 @@ class PASS(ScopeResolution, false);
  *
  */
 
-class PASS(ElideEnv, true);
+class PARALLEL_PASS(ElideEnv, true);
 
 /*
  * This pass searches for dominating force instructions.
@@ -55,7 +63,7 @@ class PASS(ForceDominance, false);
  * DelayInstr tries to schedule instructions right before they are needed.
  *
  */
-class PASS(DelayInstr, false);
+class PARALLEL_PASS(DelayInstr, false);
 
 /*
  * The DelayEnv pass tries to delay the scheduling of `MkEnv` instructions as
@@ -63,7 +71,7 @@ class PASS(DelayInstr, false);
  * the goal is to move it out of the others.
  *
  */
-class PASS(DelayEnv, false);
+class PARALLEL_PASS(DelayEnv, false);
 
 /*
  * Inlines a closure. Intentionally stupid. It does not resolve inner
@@ -93,13 +101,13 @@ class PASS(Constantfold, true);
 /*
  * Generic instruction and controlflow cleanup pass.
  */
-class PASS(Cleanup, true);
+class PARALLEL_PASS(Cleanup, true);
 
 /*
  * Checkpoints keep values alive. Thus it makes sense to remove them if they
  * are unused after a while.
  */
-class PASS(CleanupCheckpoints, true);
+class PARALLEL_PASS(CleanupCheckpoints, true);
 
 /*
  * Unused framestate instructions usually get removed automatically. Except
@@ -114,15 +122,15 @@ class PASS(CleanupFramestate, true);
  * Trying to group assumptions, by pushing them up. This well lead to fewer
  * checkpoints being used overall.
  */
-class PASS(OptimizeAssumptions, false);
+class PARALLEL_PASS(OptimizeAssumptions, false);
 
 class PASS(EagerCalls, false);
 
-class PASS(OptimizeVisibility, true);
+class PARALLEL_PASS(OptimizeVisibility, true);
 
 class PASS(OptimizeContexts, false);
 
-class PASS(DeadStoreRemoval, false);
+class PARALLEL_PASS(DeadStoreRemoval, false);
 
 class PASS(DotDotDots, false);
 
@@ -135,9 +143,9 @@ class PASS(LoopInvariant, false);
 
 class PASS(GVN, true);
 
-class PASS(LoadElision, false);
+class PARALLEL_PASS(LoadElision, false);
 
-class PASS(TypeInference, true);
+class PARALLEL_PASS(TypeInference, true);
 
 class PASS(TypeSpeculation, false);
 
@@ -147,13 +155,40 @@ class PASS(PromiseSplitter, false);
  * Range analysis to detect and optimize code which will not create overflows /
  * underflows
  */
-class PASS(Overflow, true);
+class PARALLEL_PASS(Overflow, true);
+
+/*
+ * Loops over seq_len(n) and seq_along(x) use the loop index as the loop
+ * variable, instead of extracting it from the (compact) range
+ */
+class PASS(RangeLoops, false);
+
+/*
+ * Replaces element and length accesses of short vectors built by c() with the
+ * scalar elements, also through loop phis. Unless the vector escapes, this
+ * removes the allocation, or leaves it to the deopt branches.
+ */
+class PASS(ScalarReplacement, false);
 
 /*
  * Loop Invariant Code motion
  */
 class PASS(HoistInstruction, false);
 
+/*
+ * Fuses trees of element-wise arithmetic on numeric vectors into a single
+ * VectorExpr, which does not allocate the intermediate vectors. Scheduled last,
+ * since the other passes do not know about VectorExpr.
+ */
+class PARALLEL_PASS(VectorFusion, false);
+
+/*
+ * Marks vector accesses, whose index is known to be within the bounds of the
+ * vector, such that the native backend can omit the range checks. Scheduled
+ * last, since other passes do not preserve the flag.
+ */
+class PARALLEL_PASS(BoundsChecks, false);
+
 class PhaseMarker : public Pass {
   public:
     explicit PhaseMarker(const std::string& name) : Pass(name) {}
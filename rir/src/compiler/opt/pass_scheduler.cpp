@@ -52,7 +52,9 @@ PassScheduler::PassScheduler() {
         add<Cleanup>();
 
         add<TypeInference>();
+        add<ScalarReplacement>();
         add<Overflow>();
+        add<RangeLoops>();
     };
     auto addDefaultPostPhaseOpt = [&]() {
         add<HoistInstruction>();
@@ -112,6 +114,14 @@ PassScheduler::PassScheduler() {
     addDefaultPostPhaseOpt();
     add<CleanupCheckpoints>();
 
+    // ==== Phase 5) Lower to fused vector operations
+    nextPhase("Fusion");
+    add<VectorFusion>();
+
+    // ==== Phase 6) Drop index checks proven redundant by the range analysis
+    nextPhase("Bounds checks");
+    add<BoundsChecks>();
+
     nextPhase("done");
 }
 
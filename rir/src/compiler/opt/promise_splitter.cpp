@@ -1,6 +1,6 @@
 #include "../pir/pir_impl.h"
 #include "../util/visitor.h"
-#include "compiler/analysis/cfg.h"
+#include "compiler/analysis/analysis_cache.h"
 #include "pass_definitions.h"
 #include "utils/Map.h"
 #include "utils/Set.h"
@@ -48,7 +48,7 @@ bool PromiseSplitter::apply(Compiler&, ClosureVersion* cls, Code* code,
                 banned.insert(p);
     });
 
-    CFG cfg(code);
+    auto& cfg = code->analyses().cfg();
     SmallSet<CastType*> toSplit;
     for (const auto& c : candidates) {
         const auto& us = uses.find(c);
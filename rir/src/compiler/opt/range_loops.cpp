@@ -0,0 +1,103 @@
+#include "../pir/pir_impl.h"
+#include "../util/visitor.h"
+#include "R/BuiltinIds.h"
+#include "compiler/analysis/analysis_cache.h"
+#include "pass_definitions.h"
+
+#include <unordered_set>
+
+namespace rir {
+namespace pir {
+
+// seq_len and seq_along always return the (compact) sequence 1..n
+static bool isRange(Value* v) {
+    v = v->followCasts();
+    if (auto b = CallSafeBuiltin::Cast(v))
+        return b->builtinId == blt("seq_len") ||
+               b->builtinId == blt("seq_along");
+    if (auto b = CallBuiltin::Cast(v))
+        return b->builtinId == blt("seq_len") ||
+               b->builtinId == blt("seq_along");
+    return false;
+}
+
+// The index of a for loop starts at 0 and is incremented before each access
+static bool isNonNegativeIndex(Value* v, std::unordered_set<Phi*>& seen) {
+    if (auto c = LdConst::Cast(v))
+        return IS_SIMPLE_SCALAR(c->c(), INTSXP) && INTEGER(c->c())[0] == 0;
+    if (auto inc = Inc::Cast(v))
+        return isNonNegativeIndex(inc->arg(0).val(), seen);
+    if (auto phi = Phi::Cast(v)) {
+        if (!seen.insert(phi).second)
+            return true;
+        bool res = true;
+        phi->eachArg([&](BB*, Value* a) {
+            if (!isNonNegativeIndex(a, seen))
+                res = false;
+        });
+        return res;
+    }
+    return false;
+}
+
+// Is bb only reached, if idx <= length(seq)? The loop header of a for loop
+// exits if length(seq) < idx.
+static bool inBounds(BB* bb, Value* seq, Value* idx,
+                     const DominanceGraph& dom) {
+    while (true) {
+        if (bb->predecessors().size() == 1) {
+            auto header = *bb->predecessors().begin();
+            auto branch = header->isEmpty() ? nullptr
+                                            : Branch::Cast(header->last());
+            if (branch && header->falseBranch() == bb) {
+                auto cond = branch->arg(0).val()->followCasts();
+                if (auto t = AsTest::Cast(cond))
+                    cond = t->arg(0).val()->followCasts();
+                if (auto l = AsLogical::Cast(cond))
+                    cond = l->arg(0).val()->followCasts();
+                if (auto lt = Lt::Cast(cond)) {
+                    auto len =
+                        ForSeqSize::Cast(lt->arg(0).val()->followCasts());
+                    if (len && lt->arg(1).val() == idx &&
+                        len->arg(0).val()->followCasts() == seq)
+                        return true;
+                }
+            }
+        }
+        if (!dom.hasImmediateDominator(bb))
+            return false;
+        bb = dom.immediateDominator(bb);
+    }
+}
+
+bool RangeLoops::apply(Compiler&, ClosureVersion*, Code* code,
+                       LogStream&) const {
+    bool anyChange = false;
+    auto& dom = code->analyses().dominanceGraph();
+
+    Visitor::run(code->entry, [&](BB* bb) {
+        auto it = bb->begin();
+        while (it != bb->end()) {
+            auto e = Extract2_1D::Cast(*it);
+            if (e && isRange(e->vec())) {
+                auto seq = e->vec()->followCasts();
+                auto idx = e->idx();
+                std::unordered_set<Phi*> seen;
+                if (Inc::Cast(idx) && isNonNegativeIndex(idx, seen) &&
+                    inBounds(bb, seq, idx, dom)) {
+                    // 1 <= idx <= length(seq), thus seq[[idx]] == idx
+                    e->replaceUsesWith(idx);
+                    it = bb->remove(it);
+                    anyChange = true;
+                    continue;
+                }
+            }
+            ++it;
+        }
+    });
+
+    return anyChange;
+}
+
+} // namespace pir
+} // namespace rir
@@ -0,0 +1,152 @@
+#include "../pir/pir_impl.h"
+#include "../util/visitor.h"
+#include "R/BuiltinIds.h"
+#include "pass_definitions.h"
+
+#include <cmath>
+#include <unordered_map>
+
+namespace rir {
+namespace pir {
+
+// c(a1, ..., an) of scalars of one type, without attributes. The result is the
+// vector of the arguments, thus element k is ak and the length is n.
+static CallSafeBuiltin* shortVector(Value* v) {
+    auto c = CallSafeBuiltin::Cast(v->followCasts());
+    if (!c || c->builtinId != blt("c") || c->nCallArgs() == 0)
+        return nullptr;
+    for (auto t : {RType::logical, RType::integer, RType::real}) {
+        auto elem = PirType(t).scalar().noAttribs();
+        bool all = true;
+        c->eachCallArg([&](Value* a) {
+            if (!a->type.isA(elem))
+                all = false;
+        });
+        if (all)
+            return c;
+    }
+    return nullptr;
+}
+
+// Constant index into a vector of length n, or 0
+static size_t constantIndex(Value* idx, size_t n) {
+    auto ld = LdConst::Cast(idx->followCasts());
+    if (!ld)
+        return 0;
+    double k;
+    if (IS_SIMPLE_SCALAR(ld->c(), INTSXP) &&
+        INTEGER(ld->c())[0] != NA_INTEGER)
+        k = INTEGER(ld->c())[0];
+    else if (IS_SIMPLE_SCALAR(ld->c(), REALSXP))
+        k = REAL(ld->c())[0];
+    else
+        return 0;
+    if (!(k >= 1 && k <= n) || k != floor(k))
+        return 0;
+    return k;
+}
+
+bool ScalarReplacement::apply(Compiler&, ClosureVersion*, Code* code,
+                              LogStream&) const {
+    bool anyChange = false;
+
+    // Phis of short vectors with the same length, e.g. a vector updated in a
+    // loop. Returns the length, or 0.
+    auto phiOfShortVectors = [](Phi* phi) -> size_t {
+        size_t n = 0;
+        bool ok = true;
+        phi->eachArg([&](BB*, Value* v) {
+            auto c = shortVector(v);
+            if (!c || (n && c->nCallArgs() != n))
+                ok = false;
+            else
+                n = c->nCallArgs();
+        });
+        return ok ? n : 0;
+    };
+
+    // Splits a phi of vectors into one phi per accessed element
+    std::unordered_map<Phi*, std::unordered_map<size_t, Phi*>> elementPhis;
+    auto elementPhi = [&](Phi* phi, size_t k) {
+        auto& p = elementPhis[phi][k];
+        if (!p) {
+            p = new Phi;
+            auto type = PirType::bottom();
+            phi->eachArg([&](BB* in, Value* v) {
+                auto e = shortVector(v)->callArg(k - 1).val();
+                p->addInput(in, e);
+                type = type | e->type;
+            });
+            p->type = type;
+            phi->bb()->insert(phi->bb()->begin(), p);
+        }
+        return p;
+    };
+
+    // Escape analysis: reading an element or the length does not need the
+    // vector. If these are the only uses left, the allocation is removed, or
+    // sunk into the deopt branches which need it by DelayInstr.
+    Visitor::run(code->entry, [&](BB* bb) {
+        auto ip = bb->begin();
+        while (ip != bb->end()) {
+            auto i = *ip;
+            Value* vec = nullptr;
+            Value* idx = nullptr;
+            if (auto e = Extract1_1D::Cast(i)) {
+                vec = e->vec();
+                idx = e->idx();
+            } else if (auto e = Extract2_1D::Cast(i)) {
+                vec = e->vec();
+                idx = e->idx();
+            } else if (auto l = XLength::Cast(i)) {
+                vec = l->arg(0).val();
+            }
+
+            Value* replacement = nullptr;
+            if (vec) {
+                if (auto c = shortVector(vec)) {
+                    auto n = c->nCallArgs();
+                    if (!idx) {
+                        replacement = new LdConst((int)n);
+                    } else if (auto k = constantIndex(idx, n)) {
+                        replacement = c->callArg(k - 1).val();
+                    }
+                } else if (auto phi = Phi::Cast(vec->followCasts())) {
+                    if (auto n = phiOfShortVectors(phi)) {
+                        if (!idx) {
+                            replacement = new LdConst((int)n);
+                        } else if (auto k = constantIndex(idx, n)) {
+                            replacement = elementPhi(phi, k);
+                            // The new phi might be inserted into this bb
+                            ip = bb->atPosition(i);
+                        }
+                    }
+                }
+            }
+
+            if (replacement) {
+                if (auto ld = LdConst::Cast(replacement)) {
+                    ip = bb->insert(ip, ld) + 1;
+                }
+                i->replaceUsesWith(replacement);
+                ip = bb->remove(ip);
+                anyChange = true;
+                continue;
+            }
+            ++ip;
+        }
+    });
+
+    // The elements of c() are scalars of one type, no coercion can fail
+    Visitor::run(code->entry, [&](Instruction* i) {
+        if (shortVector(i) == i) {
+            i->effects.reset(Effect::Warn);
+            i->effects.reset(Effect::Error);
+        }
+    });
+
+    return anyChange;
+}
+
+} // namespace pir
+} // namespace rir
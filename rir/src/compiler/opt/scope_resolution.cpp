@@ -1,3 +1,4 @@
+#include "../analysis/analysis_cache.h"
 #include "../analysis/query.h"
 #include "../analysis/scope.h"
 #include "../pir/pir_impl.h"
@@ -94,8 +95,8 @@ namespace pir {
 bool ScopeResolution::apply(Compiler&, ClosureVersion* cls, Code* code,
                             LogStream& log) const {
 
-    DominanceGraph dom(code);
-    DominanceFrontier dfront(code, dom);
+    auto& dom = code->analyses().dominanceGraph();
+    auto& dfront = code->analyses().dominanceFrontier();
 
     bool anyChange = false;
     ScopeAnalysis analysis(cls, code, log);
@@ -88,7 +88,10 @@ bool TypeInference::apply(Compiler&, ClosureVersion* cls, Code* code,
                         }
                     }
 
-                    if ("sqrt" == name) {
+                    static const std::unordered_set<std::string> math1 = {
+                        "sqrt", "exp", "floor", "ceiling",
+                        "sin",  "cos", "log2",  "log10"};
+                    if (math1.count(name)) {
                         if (c->nCallArgs()) {
                             auto m = PirType::bottom();
                             for (size_t i = 0; i < c->nCallArgs(); ++i)
@@ -97,7 +100,12 @@ bool TypeInference::apply(Compiler&, ClosureVersion* cls, Code* code,
                             if (!m.maybeObj()) {
                                 inferred = m & PirType::num();
                                 inferred = inferred.orT(RType::real)
-                                               .notT(RType::integer);
+                                               .notT(RType::integer)
+                                               .notT(RType::logical);
+                                // e.g. sqrt(-1) or sin(Inf)
+                                if (name != "exp" && name != "floor" &&
+                                    name != "ceiling")
+                                    inferred = inferred.orNAOrNaN();
                                 break;
                             }
                         }
@@ -0,0 +1,118 @@
+#include "../pir/pir_impl.h"
+#include "../util/visitor.h"
+#include "compiler/analysis/cfg.h"
+#include "pass_definitions.h"
+
+#include <functional>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace rir {
+namespace pir {
+
+static bool isFusable(Instruction* i) {
+    if (!Add::Cast(i) && !Sub::Cast(i) && !Mul::Cast(i) && !Div::Cast(i))
+        return false;
+    if (i->hasEnv())
+        return false;
+    static const PirType operand = PirType::intReal().notObject();
+    return i->arg(0).val()->type.isA(operand) &&
+           i->arg(1).val()->type.isA(operand);
+}
+
+static VectorExpr::Op opOf(Instruction* i) {
+    switch (i->tag) {
+    case Tag::Add:
+        return VectorExpr::Op::Add;
+    case Tag::Sub:
+        return VectorExpr::Op::Sub;
+    case Tag::Mul:
+        return VectorExpr::Op::Mul;
+    case Tag::Div:
+        return VectorExpr::Op::Div;
+    default:
+        assert(false);
+        return VectorExpr::Op::Arg;
+    }
+}
+
+bool VectorFusion::apply(Compiler&, ClosureVersion*, Code* code,
+                         LogStream&) const {
+    bool anyChange = false;
+    UsesTree uses(code);
+
+    Visitor::run(code->entry, [&](BB* bb) {
+        // Fusing moves the evaluation of the inner nodes down to the root.
+        // This is only allowed if nothing in between could observe it, or
+        // modify the operands in place.
+        std::unordered_map<Instruction*, size_t> pos;
+        std::vector<size_t> lastBarrier;
+        for (auto i : *bb) {
+            auto p = pos.size();
+            pos[i] = p;
+            bool barrier = i->hasStrongEffects() && !isFusable(i);
+            lastBarrier.push_back(barrier ? p + 1
+                                          : (p ? lastBarrier.back() : 0));
+        }
+
+        struct Tree {
+            Instruction* root;
+            std::vector<Instruction*> inner;
+            std::vector<Value*> args;
+            std::vector<VectorExpr::Op> ops;
+        };
+        std::vector<Tree> trees;
+        std::unordered_set<Instruction*> fused;
+
+        for (auto it = bb->rbegin(); it != bb->rend(); ++it) {
+            auto root = *it;
+            if (fused.count(root) || !isFusable(root) || root->type.isScalar())
+                continue;
+
+            Tree tree{root, {}, {}, {}};
+            std::function<void(Instruction*)> collect =
+                [&](Instruction* node) {
+                    auto lhs = node->arg(0).val();
+                    auto rhs = node->arg(1).val();
+                    for (auto a : {lhs, rhs}) {
+                        auto child = Instruction::Cast(a);
+                        // Operands used twice, e.g. (a + b) * (a + b), would
+                        // have to be evaluated twice
+                        if (child && lhs != rhs && child->bb() == bb &&
+                            isFusable(child) && uses.at(child).size() == 1 &&
+                            lastBarrier[pos.at(root)] <= pos.at(child)) {
+                            tree.inner.push_back(child);
+                            collect(child);
+                        } else {
+                            tree.args.push_back(a);
+                            tree.ops.push_back(VectorExpr::Op::Arg);
+                        }
+                    }
+                    tree.ops.push_back(opOf(node));
+                };
+            collect(root);
+
+            // A single operation is already handled by the binop kernels
+            if (tree.inner.empty())
+                continue;
+            fused.insert(tree.inner.begin(), tree.inner.end());
+            trees.push_back(tree);
+        }
+
+        for (auto& tree : trees) {
+            auto e = new VectorExpr(tree.root->type, tree.root->srcIdx);
+            e->ops = tree.ops;
+            for (auto a : tree.args)
+                e->pushArg(a, PirType::val());
+            tree.root->replaceUsesAndSwapWith(e, bb->atPosition(tree.root));
+            for (auto i : tree.inner)
+                bb->remove(i);
+            anyChange = true;
+        }
+    });
+
+    return anyChange;
+}
+
+} // namespace pir
+} // namespace rir
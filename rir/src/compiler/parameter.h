@@ -13,6 +13,8 @@ struct Parameter {
     static size_t MAX_INPUT_SIZE;
     static unsigned RIR_WARMUP;
     static unsigned DEOPT_ABANDON;
+    static unsigned DEOPT_RESPECIALIZE;
+    static unsigned PIR_OSR;
 
     static size_t PROMISE_INLINER_MAX_SIZE;
 
@@ -20,6 +22,7 @@ struct Parameter {
     static size_t INLINER_MAX_INLINEE_SIZE;
     static size_t INLINER_INITIAL_FUEL;
     static size_t INLINER_INLINE_UNLIKELY;
+    static size_t INLINER_HOT_SAMPLES;
 
     static bool RIR_PRESERVE;
     static unsigned RIR_SERIALIZE_CHAOS;
@@ -27,6 +30,11 @@ struct Parameter {
     static unsigned RIR_CHECK_PIR_TYPES;
 
     static unsigned PIR_LLVM_OPT_LEVEL;
+    static unsigned PIR_LLVM_TIER_UP;
+    static bool PIR_ASYNC_COMPILE;
+    static bool PIR_NATIVE_CACHE;
+    static unsigned PIR_PERF_MAP;
+    static size_t PIR_OPT_THREADS;
 };
 } // namespace pir
 } // namespace rir
@@ -4,6 +4,7 @@
 #include "common.h"
 #include "pir.h"
 
+#include "compiler/util/arena.h"
 #include "utils/Set.h"
 #include <unordered_set>
 
@@ -29,7 +30,7 @@ class Code;
  * the BB id as array indices).
  *
  */
-class BB {
+class BB : public ArenaAllocated {
   public:
     // The visitor relies on stable ids, do not renumber inside a visitor!!!
     const unsigned id;
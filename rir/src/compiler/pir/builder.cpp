@@ -126,6 +126,16 @@ Builder::Builder(ClosureVersion* version, Value* closureEnv)
     this->env = mkenv;
 }
 
+Builder::Builder(ClosureVersion* version)
+    : function(version), code(version), env(Env::notClosed()) {
+    createNextBB();
+    assert(!function->entry);
+    function->entry = bb;
+
+    // Create another BB to ensure that the entry BB has no predecessors.
+    createNextBB();
+}
+
 Builder::Builder(ClosureVersion* fun, Promise* prom)
     : function(fun), code(prom), env(nullptr) {
     createNextBB();
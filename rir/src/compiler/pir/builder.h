@@ -27,6 +27,9 @@ class Builder {
 
     Builder(ClosureVersion* fun, Promise* prom);
     Builder(ClosureVersion* fun, Value* enclos);
+    // Continues an invocation which is already running, e.g. after on-stack
+    // replacement. Its environment is passed as the closure environment.
+    explicit Builder(ClosureVersion* fun);
 
     Value* buildDefaultEnv(ClosureVersion* fun);
 
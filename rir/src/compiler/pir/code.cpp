@@ -1,4 +1,5 @@
 #include "code.h"
+#include "../analysis/analysis_cache.h"
 #include "../util/visitor.h"
 #include "pir_impl.h"
 
@@ -36,6 +37,7 @@ void Code::printBBGraphCode(std::ostream& out, bool omitDeoptBranches) const {
 }
 
 Code::~Code() {
+    delete analyses_;
     std::stack<BB*> toDel;
     Visitor::run(entry, [&toDel](BB* bb) { toDel.push(bb); });
     while (!toDel.empty()) {
@@ -46,6 +48,12 @@ Code::~Code() {
     }
 }
 
+AnalysisCache& Code::analyses() {
+    if (!analyses_)
+        analyses_ = new AnalysisCache(this);
+    return *analyses_;
+}
+
 size_t Code::size() const {
     size_t s = 0;
     Visitor::run(entry, [&](BB* bb) { s += bb->size(); });
@@ -6,6 +6,8 @@
 namespace rir {
 namespace pir {
 
+class AnalysisCache;
+
 /*
  * A piece of code, starting at the BB entry.
  *
@@ -25,6 +27,12 @@ class Code {
     virtual ~Code();
 
     virtual size_t size() const;
+
+    // Analyses of the control flow graph, shared between passes
+    AnalysisCache& analyses();
+
+  private:
+    AnalysisCache* analyses_ = nullptr;
 };
 
 }
@@ -847,6 +847,31 @@ void CallSafeBuiltin::printArgs(std::ostream& out, bool tty) const {
     printCallArgs(out, this);
 }
 
+void VectorExpr::printArgs(std::ostream& out, bool tty) const {
+    // Prints the tree in infix notation, rebuilt from the postfix program
+    std::vector<std::string> stack;
+    size_t arg = 0;
+    for (auto op : ops) {
+        if (op == Op::Arg) {
+            std::stringstream ref;
+            this->arg(arg++).val()->printRef(ref);
+            stack.push_back(ref.str());
+            continue;
+        }
+        auto rhs = stack.back();
+        stack.pop_back();
+        auto lhs = stack.back();
+        stack.pop_back();
+        const char* sym = op == Op::Add   ? " + "
+                          : op == Op::Sub ? " - "
+                          : op == Op::Mul ? " * "
+                                          : " / ";
+        stack.push_back("(" + lhs + sym + rhs + ")");
+    }
+    assert(stack.size() == 1);
+    out << stack.back();
+}
+
 void FrameState::printArgs(std::ostream& out, bool tty) const {
     out << code << "+" << pc - code->code();
     if (inPromise)
@@ -9,6 +9,7 @@
 #include "pir.h"
 #include "singleton_values.h"
 #include "tag.h"
+#include "compiler/util/arena.h"
 #include "value.h"
 
 #include <algorithm>
@@ -148,7 +149,7 @@ struct TypeFeedback {
 class DominanceGraph;
 class MkEnv;
 class FrameState;
-class Instruction : public Value {
+class Instruction : public Value, public ArenaAllocated {
   public:
     struct InstructionUID : public std::pair<unsigned, unsigned> {
         InstructionUID(unsigned a, unsigned b)
@@ -1481,6 +1482,9 @@ class FLIE(Extract1_1D, 3, Effects::Any()) {
     Value* vec() const { return arg(0).val(); }
     Value* idx() const { return arg(1).val(); }
 
+    // idx is known to be between 1 and the length of vec (see BoundsChecks)
+    bool inBounds = false;
+
     PirType inferType(const GetType& getType) const override final;
     Effects inferEffects(const GetType& getType) const override final {
         return ifNonObjectArgs(getType, effects & errorWarnVisible, effects);
@@ -1501,6 +1505,9 @@ class FLIE(Extract2_1D, 3, Effects::Any()) {
     Value* vec() const { return arg(0).val(); }
     Value* idx() const { return arg(1).val(); }
 
+    // idx is known to be between 1 and the length of vec (see BoundsChecks)
+    bool inBounds = false;
+
     PirType inferType(const GetType& getType) const override final {
         return ifNonObjectArgs(
             getType, type & getType(vec()).extractType(getType(idx())), type);
@@ -1878,6 +1885,27 @@ BINOP_NOENV(LOr, PirType::simpleScalarLogical());
 
 #undef BINOP_NOENV
 
+/*
+ * A tree of element-wise arithmetic on numeric vectors without attributes
+ * (see VectorFusion). It is evaluated chunk by chunk in one loop, without
+ * allocating the intermediate vectors. The tree is stored in postfix order
+ * and every Arg leaf refers to the next argument.
+ */
+class VLI(VectorExpr,
+          Effects(Effect::Warn) | Effect::Error | Effect::Visibility) {
+  public:
+    enum class Op : uint8_t { Arg, Add, Sub, Mul, Div };
+    std::vector<Op> ops;
+
+    explicit VectorExpr(PirType resultType, unsigned srcIdx)
+        : VarLenInstruction(resultType, srcIdx) {}
+
+    void printArgs(std::ostream& out, bool tty) const override;
+    VisibilityFlag visibilityFlag() const override {
+        return VisibilityFlag::On;
+    }
+};
+
 template <typename BASE, Tag TAG>
 class Unop
     : public FixedLenInstructionWithEnvSlot<TAG, BASE, 2, Effects::AnyI(),
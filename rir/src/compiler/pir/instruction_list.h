@@ -77,6 +77,7 @@
     V(LdFunctionEnv)                                                           \
     V(LAnd)                                                                    \
     V(LOr)                                                                     \
+    V(VectorExpr)                                                              \
     V(Not)                                                                     \
     V(Inc)                                                                     \
     V(Is)                                                                      \
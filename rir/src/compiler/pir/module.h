@@ -9,12 +9,16 @@
 #include <vector>
 
 #include "pir.h"
+#include "compiler/util/arena.h"
 #include "runtime/Function.h"
 
 namespace rir {
 namespace pir {
 
 class Module {
+    // Owns the IR of all closures, must outlive them
+    Arena arena;
+
     std::unordered_map<SEXP, Env*> environments;
 
   public:
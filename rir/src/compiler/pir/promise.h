@@ -2,13 +2,14 @@
 #define COMPILER_PROMISE_H
 
 #include "code.h"
+#include "compiler/util/arena.h"
 
 namespace rir {
 namespace pir {
 
 class LdFunctionEnv;
 
-class Promise : public Code {
+class Promise : public Code, public ArenaAllocated {
   public:
     const unsigned id;
     ClosureVersion* owner;
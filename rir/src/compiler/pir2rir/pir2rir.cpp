@@ -868,6 +868,41 @@ rir::Code* Pir2Rir::compileCode(Context& ctx, Code* code) {
                 SIMPLE_WITH_SRCIDX(Subassign1_3D, subassign1_3);
 #undef SIMPLE_WITH_SRCIDX
 
+            case Tag::VectorExpr: {
+                // The RIR interpreter has no fused kernel, thus the tree is
+                // unfolded again: every leaf pulls its argument, every node
+                // is a regular arithmetic instruction.
+                auto e = VectorExpr::Cast(instr);
+                size_t n = e->nargs();
+                size_t arg = 0;
+                size_t temps = 0;
+                for (auto op : e->ops) {
+                    switch (op) {
+                    case VectorExpr::Op::Arg:
+                        cb.add(BC::pull(temps + n - 1 - arg++));
+                        temps++;
+                        continue;
+                    case VectorExpr::Op::Add:
+                        cb.add(BC::add(), e->srcIdx);
+                        break;
+                    case VectorExpr::Op::Sub:
+                        cb.add(BC::sub(), e->srcIdx);
+                        break;
+                    case VectorExpr::Op::Mul:
+                        cb.add(BC::mul(), e->srcIdx);
+                        break;
+                    case VectorExpr::Op::Div:
+                        cb.add(BC::div(), e->srcIdx);
+                        break;
+                    }
+                    temps--;
+                }
+                assert(temps == 1);
+                cb.add(BC::put(n));
+                cb.add(BC::popn(n));
+                break;
+            }
+
             case Tag::Call: {
                 auto call = Call::Cast(instr);
                 if (compileCallDots(call, call->srcIdx, []() {},
@@ -1161,13 +1196,23 @@ rir::Code* Pir2Rir::compileCode(Context& ctx, Code* code) {
     auto localsCnt = alloc.slots();
     auto res = ctx.finalizeCode(localsCnt, cache.size());
     if (PIR_NATIVE_BACKEND) {
+        auto start = std::chrono::steady_clock::now();
         LowerLLVM native;
-        if (auto n = native.tryCompile(cls, code, promMap, refcount,
-                                       needsLdVarForUpdate, log.out())) {
+        if (Parameter::PIR_ASYNC_COMPILE) {
+            native.tryCompileAsync(cls, code, promMap, refcount,
+                                   needsLdVarForUpdate, log.out(), res);
+        } else if (auto n = native.tryCompile(cls, code, promMap, refcount,
+                                              needsLdVarForUpdate, log.out(),
+                                              res)) {
             res->nativeCode = (NativeCode)n;
+            res->nativeCodeUnboxed = native.nativeCodeUnboxed;
+            res->unboxedSignature = native.unboxedSignature;
             if (native.pirTypeFeedback)
                 res->pirTypeFeedback(native.pirTypeFeedback);
         }
+        std::chrono::duration<double> duration =
+            std::chrono::steady_clock::now() - start;
+        compiler.llvmTime += duration.count();
     }
     return res;
 }
@@ -1357,6 +1402,7 @@ rir::Function* Pir2Rir::finalize() {
         function.addArgWithoutDefault();
         signature.pushDefaultArgument();
     }
+    signature.hasDotsFormals = cls->owner()->formals().hasDots();
 
     assert(signature.formalNargs() == cls->nargs());
     ctx.push(R_NilValue);
@@ -22,6 +22,9 @@ class Pir2RirCompiler {
 
     StreamLogger& logger;
 
+    // Seconds spent in the native backend, over all compiled versions
+    double llvmTime = 0;
+
     Function* alreadyCompiled(ClosureVersion* cls) {
         return done.count(cls) ? done.at(cls) : nullptr;
     }
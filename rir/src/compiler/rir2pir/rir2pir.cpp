@@ -368,7 +368,8 @@ bool Rir2Pir::compileBC(const BC& bc, Opcode* pos, Opcode* nextPos,
     }
 
     case Opcode::record_type_: {
-        if (bc.immediate.typeFeedback.numTypes) {
+        if (bc.immediate.typeFeedback.numTypes &&
+            !bc.immediate.typeFeedback.speculationDisabled) {
             auto feedback = bc.immediate.typeFeedback;
             if (auto i = Instruction::Cast(at(0))) {
                 // Search for the most specific feedabck for this location
@@ -416,7 +417,7 @@ bool Rir2Pir::compileBC(const BC& bc, Opcode* pos, Opcode* nextPos,
             insert(new RecordDeoptReason(reason, target));
             insert(new Deopt(sp));
             stack.clear();
-        } else {
+        } else if (!feedback.speculationDisabled) {
             std::get<ObservedCallees>(callTargetFeedback[target]) =
                 bc.immediate.callFeedback;
             std::get<Opcode*>(callTargetFeedback[target]) = pos;
@@ -1163,6 +1164,28 @@ bool Rir2Pir::tryCompile(rir::Code* srcCode, Builder& insert) {
     return false;
 }
 
+bool Rir2Pir::tryCompileContinuation(
+    Builder& insert, Opcode* start, const std::vector<PirType>& initialStack) {
+    // seenC selects how calls to c are guarded: with an ldvar of c, or, if
+    // there might be a local variable called c, with the ldfun. The ldfun
+    // guard is correct in any case, it only costs forcing promises in the
+    // guard. The code before start is not translated and might bind c, thus
+    // we always pick it.
+    compiler.seenC = true;
+    std::vector<Value*> stack;
+    for (size_t i = 0; i < initialStack.size(); ++i) {
+        auto arg = insert(new LdArg(i));
+        arg->type = initialStack[i];
+        stack.push_back(arg);
+    }
+    auto srcCode = cls->owner()->rirFunction()->body();
+    if (auto res = tryTranslate(srcCode, insert, start, stack)) {
+        finalize(res, insert);
+        return true;
+    }
+    return false;
+}
+
 bool Rir2Pir::tryCompilePromise(rir::Code* prom, Builder& insert) {
     return PromiseRir2Pir(compiler, cls, log, name, outerFeedback, false)
         .tryCompile(prom, insert);
@@ -1174,6 +1197,12 @@ Value* Rir2Pir::tryInlinePromise(rir::Code* srcCode, Builder& insert) {
 }
 
 Value* Rir2Pir::tryTranslate(rir::Code* srcCode, Builder& insert) {
+    return tryTranslate(srcCode, insert, srcCode->code(), {});
+}
+
+Value* Rir2Pir::tryTranslate(rir::Code* srcCode, Builder& insert,
+                             Opcode* start,
+                             const std::vector<Value*>& initialStack) {
     assert(!finalized);
 
     CallTargetFeedback callTargetFeedback;
@@ -1186,9 +1215,11 @@ Value* Rir2Pir::tryTranslate(rir::Code* srcCode, Builder& insert) {
     std::deque<State> worklist;
     State cur;
     cur.seen = true;
+    for (auto v : initialStack)
+        cur.stack.push(v);
 
     Opcode* end = srcCode->endCode();
-    Opcode* finger = srcCode->code();
+    Opcode* finger = start;
 
     auto popWorklist = [&]() {
         assert(!worklist.empty());
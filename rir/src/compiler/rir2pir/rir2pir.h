@@ -21,6 +21,12 @@ class Rir2Pir {
 
     bool tryCompile(Builder& insert) __attribute__((warn_unused_result));
 
+    // Compiles the rest of the function from start on. The values on the
+    // operand stack at start are passed as arguments, with the given types.
+    bool tryCompileContinuation(Builder& insert, Opcode* start,
+                                const std::vector<PirType>& initialStack)
+        __attribute__((warn_unused_result));
+
     Value* tryCreateArg(rir::Code* prom, Builder& insert, bool eager)
         __attribute__((warn_unused_result));
 
@@ -37,6 +43,9 @@ class Rir2Pir {
 
     Value* tryTranslate(rir::Code* srcCode, Builder& insert)
         __attribute__((warn_unused_result));
+    Value* tryTranslate(rir::Code* srcCode, Builder& insert, Opcode* start,
+                        const std::vector<Value*>& initialStack)
+        __attribute__((warn_unused_result));
 
     void finalize(Value*, Builder& insert);
 
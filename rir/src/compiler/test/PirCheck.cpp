@@ -5,6 +5,7 @@
 #include "../pir/pir_impl.h"
 #include "../pir2rir/pir2rir.h"
 #include "../util/visitor.h"
+#include "R/BuiltinIds.h"
 #include "api.h"
 #include "compiler/compiler.h"
 #include "compiler/parameter.h"
@@ -171,6 +172,15 @@ static bool testTwoAdd(ClosureVersion* f) {
     return numAdds == 2;
 }
 
+static bool testOneVectorExpr(ClosureVersion* f) {
+    int numExprs = 0;
+    Visitor::run(f->entry, [&](Instruction* i) {
+        if (VectorExpr::Cast(i))
+            numExprs++;
+    });
+    return numExprs == 1;
+}
+
 static bool testLdVarVectorInFirstBB(ClosureVersion* f) {
     for (auto instruction : *f->entry) {
         if (auto ldvar = LdVar::Cast(instruction)) {
@@ -220,6 +230,13 @@ static bool testAnAddIsNotNAOrNaN(ClosureVersion* f) {
     return success;
 }
 
+static bool testNoCombine(ClosureVersion* f) {
+    return VisitorNoDeoptBranch::check(f->entry, [&](Instruction* i) {
+        auto b = CallSafeBuiltin::Cast(i);
+        return !b || b->builtinId != blt("c");
+    });
+}
+
 PirCheck::Type PirCheck::parseType(const char* str) {
 #define V(Check)                                                               \
     if (strcmp(str, #Check) == 0)                                              \
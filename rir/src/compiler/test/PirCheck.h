@@ -28,7 +28,9 @@ namespace rir {
     V(LazyCallArgs)                                                            \
     V(EagerCallArgs)                                                           \
     V(LdVarVectorInFirstBB)                                                    \
-    V(AnAddIsNotNAOrNaN)
+    V(AnAddIsNotNAOrNaN)                                                       \
+    V(OneVectorExpr)                                                           \
+    V(NoCombine)
 
 struct PirCheck {
     enum class Type : unsigned {
@@ -0,0 +1,68 @@
+#include "arena.h"
+
+#include <cassert>
+#include <cstdlib>
+
+namespace rir {
+namespace pir {
+
+// Every node is preceded by the arena it was allocated in, such that delete
+// knows whether to free it. The header keeps the node maximally aligned.
+static constexpr size_t HEADER_SIZE = alignof(std::max_align_t);
+static_assert(HEADER_SIZE >= sizeof(Arena*), "header too small");
+
+Arena* Arena::current_ = nullptr;
+
+Arena::Arena() : previous(current_) { current_ = this; }
+
+Arena::~Arena() {
+    assert(current_ == this && "arenas must be destroyed in reverse order");
+    current_ = previous;
+    for (auto c : chunks)
+        free(c);
+}
+
+void Arena::unwind(Arena* to) {
+    // Called before the longjmp, thus the arenas are still alive
+    while (current_ != to) {
+        auto arena = current_;
+        current_ = arena->previous;
+        for (auto c : arena->chunks)
+            free(c);
+        arena->chunks.clear();
+        arena->pos = arena->end = nullptr;
+    }
+}
+
+void* Arena::allocate(size_t size) {
+    size = (size + HEADER_SIZE - 1) / HEADER_SIZE * HEADER_SIZE;
+    std::lock_guard<std::mutex> lock(mutex);
+    if ((size_t)(end - pos) < size) {
+        auto chunkSize = size > CHUNK_SIZE ? size : CHUNK_SIZE;
+        pos = (char*)malloc(chunkSize);
+        end = pos + chunkSize;
+        chunks.push_back(pos);
+    }
+    auto res = pos;
+    pos += size;
+    return res;
+}
+
+void* ArenaAllocated::operator new(size_t size) {
+    auto arena = Arena::current();
+    char* base = arena ? (char*)arena->allocate(HEADER_SIZE + size)
+                       : (char*)malloc(HEADER_SIZE + size);
+    *(Arena**)base = arena;
+    return base + HEADER_SIZE;
+}
+
+void ArenaAllocated::operator delete(void* p) {
+    if (!p)
+        return;
+    auto base = (char*)p - HEADER_SIZE;
+    if (!*(Arena**)base)
+        free(base);
+}
+
+} // namespace pir
+} // namespace rir
@@ -0,0 +1,77 @@
+#ifndef PIR_ARENA_H
+#define PIR_ARENA_H
+
+#include "R/r.h"
+
+#include <cstddef>
+#include <mutex>
+#include <vector>
+
+namespace rir {
+namespace pir {
+
+/*
+ * Region allocator for the IR of a Module. Nodes are bump allocated from large
+ * chunks, which are only released when the arena is destroyed. Deleting a node
+ * runs its destructor, but does not free its memory.
+ *
+ * Arenas form a stack, the most recently created one is the current arena.
+ * Parallel passes allocate from the current arena on the worker threads.
+ *
+ * An R error during a compilation longjmps past the destructors of its
+ * arenas. Compilations therefore run in withCleanup, which pops the arenas
+ * left behind and releases their memory.
+ */
+class Arena {
+  public:
+    Arena();
+    ~Arena();
+
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+
+    void* allocate(size_t size);
+
+    static Arena* current() { return current_; }
+
+    // Runs f, such that the arenas it creates are popped even if f is left by
+    // a longjmp
+    template <typename F>
+    static void withCleanup(F f) {
+        R_ExecWithCleanup(
+            [](void* data) -> SEXP {
+                (*(F*)data)();
+                return R_NilValue;
+            },
+            &f, [](void* data) { unwind((Arena*)data); }, current_);
+    }
+
+  private:
+    static constexpr size_t CHUNK_SIZE = 64 * 1024;
+
+    std::mutex mutex;
+    std::vector<char*> chunks;
+    char* pos = nullptr;
+    char* end = nullptr;
+
+    Arena* previous;
+    static Arena* current_;
+
+    // Pops and releases the arenas on top of the given one
+    static void unwind(Arena* to);
+};
+
+/*
+ * IR nodes are allocated in the current arena, or on the heap if there is
+ * none (e.g. outside of a compilation).
+ */
+class ArenaAllocated {
+  public:
+    static void* operator new(size_t size);
+    static void operator delete(void* p);
+};
+
+} // namespace pir
+} // namespace rir
+
+#endif
@@ -0,0 +1,61 @@
+#include "thread_pool.h"
+
+namespace rir {
+namespace pir {
+
+ThreadPool::ThreadPool(size_t n) {
+    for (size_t i = 0; i < n; ++i)
+        workers.emplace_back([this]() { work(); });
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stop = true;
+    }
+    wake.notify_all();
+    for (auto& w : workers)
+        w.join();
+}
+
+// Takes jobs of the current batch until there are none left. The lock is
+// released while a job runs.
+void ThreadPool::runJobs(std::unique_lock<std::mutex>& lock) {
+    while (next < size) {
+        auto i = next++;
+        lock.unlock();
+        (*job)(i);
+        lock.lock();
+        if (++finished == size)
+            done.notify_all();
+    }
+}
+
+void ThreadPool::work() {
+    std::unique_lock<std::mutex> lock(mutex);
+    size_t seen = generation;
+    while (true) {
+        wake.wait(lock, [&]() { return stop || generation != seen; });
+        if (stop)
+            return;
+        seen = generation;
+        runJobs(lock);
+    }
+}
+
+void ThreadPool::parallelFor(size_t n,
+                             const std::function<void(size_t)>& job) {
+    std::unique_lock<std::mutex> lock(mutex);
+    this->job = &job;
+    next = 0;
+    size = n;
+    finished = 0;
+    generation++;
+    wake.notify_all();
+    runJobs(lock);
+    done.wait(lock, [&]() { return finished == size; });
+    this->job = nullptr;
+}
+
+} // namespace pir
+} // namespace rir
@@ -0,0 +1,47 @@
+#ifndef PIR_THREAD_POOL
+#define PIR_THREAD_POOL
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace rir {
+namespace pir {
+
+/*
+ * A fixed set of worker threads to run independent jobs in parallel. R is
+ * single threaded, thus the jobs must not touch the R heap (allocation, the
+ * constant pool, the protect stack, errors and warnings).
+ */
+class ThreadPool {
+  public:
+    explicit ThreadPool(size_t workers);
+    ~ThreadPool();
+
+    // Runs job(0) ... job(n - 1) on the workers and the calling thread.
+    // Returns once all of them are done.
+    void parallelFor(size_t n, const std::function<void(size_t)>& job);
+
+  private:
+    void work();
+    void runJobs(std::unique_lock<std::mutex>& lock);
+
+    std::vector<std::thread> workers;
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable done;
+
+    const std::function<void(size_t)>* job = nullptr;
+    size_t next = 0;
+    size_t size = 0;
+    size_t finished = 0;
+    size_t generation = 0;
+    bool stop = false;
+};
+
+} // namespace pir
+} // namespace rir
+
+#endif
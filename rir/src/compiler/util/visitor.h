@@ -325,8 +325,8 @@ class VisitorImplementation {
 
   private:
     static bool coinFlip() {
-        static std::mt19937 gen(42);
-        static std::bernoulli_distribution coin(0.5);
+        static thread_local std::mt19937 gen(42);
+        static thread_local std::bernoulli_distribution coin(0.5);
         return coin(gen);
     };
 
@@ -0,0 +1,160 @@
+#include "cache.h"
+
+#include <algorithm>
+#include <cstdint>
+
+namespace rir {
+
+static constexpr size_t FUN_CACHE_SIZE = 1024;
+// Lookups which skip more bindings are not cached
+static constexpr size_t FUN_CACHE_MAX_SKIPPED = 4;
+
+static SEXP bindingValue(SEXP cell, SEXP sym) {
+    return cell ? CAR(cell) : SYMVALUE(sym);
+}
+
+struct FunCacheBinding {
+    // The binding cell, nullptr for the base environments, which store their
+    // bindings in the symbol
+    SEXP cell;
+    // The value of the binding, i.e. the function or a promise of it for the
+    // binding the function was found in
+    SEXP value;
+
+    bool valid(SEXP sym) const { return bindingValue(cell, sym) == value; }
+};
+
+struct FunCacheEntry {
+    SEXP sym;
+    SEXP start;
+    FunCacheBinding found;
+    // Bindings in the frames between start and found, which were skipped
+    // because they do not hold a function. An assignment could change that.
+    FunCacheBinding skipped[FUN_CACHE_MAX_SKIPPED];
+    size_t numSkipped;
+    SEXP fun;
+
+    bool valid() const {
+        if (!found.valid(sym))
+            return false;
+        for (size_t i = 0; i < numSkipped; ++i)
+            if (!skipped[i].valid(sym))
+                return false;
+        return true;
+    }
+};
+
+static FunCacheEntry funCache[FUN_CACHE_SIZE];
+
+// Keeps the start environments and the binding values of the entries alive.
+// The binding cells are reachable from the start environments, thus an address
+// in the cache is never reused.
+static SEXP funCacheRoots = nullptr;
+
+static size_t funCacheSlot(SEXP sym, SEXP start) {
+    auto h = ((uintptr_t)sym >> 4) ^ ((uintptr_t)start >> 7);
+    return h & (FUN_CACHE_SIZE - 1);
+}
+
+static bool isBaseEnv(SEXP rho) {
+    return rho == R_BaseNamespace || rho == R_BaseEnv;
+}
+
+static void store(SEXP sym, SEXP start, const FunCacheBinding& found,
+                  const FunCacheBinding* skipped, size_t numSkipped,
+                  SEXP fun) {
+    if (!funCacheRoots) {
+        funCacheRoots = Rf_allocVector(VECSXP, FUN_CACHE_SIZE);
+        R_PreserveObject(funCacheRoots);
+    }
+    SEXP roots = Rf_allocVector(VECSXP, 2 + numSkipped);
+    SET_VECTOR_ELT(roots, 0, start);
+    SET_VECTOR_ELT(roots, 1, found.value);
+    for (size_t i = 0; i < numSkipped; ++i)
+        SET_VECTOR_ELT(roots, 2 + i, skipped[i].value);
+
+    auto slot = funCacheSlot(sym, start);
+    SET_VECTOR_ELT(funCacheRoots, slot, roots);
+    auto& e = funCache[slot];
+    e.sym = sym;
+    e.start = start;
+    e.found = found;
+    std::copy(skipped, skipped + numSkipped, e.skipped);
+    e.numSkipped = numSkipped;
+    e.fun = fun;
+}
+
+// Records where fun was found, if all environments from start to there are
+// locked. Otherwise a later binding could shadow it, which is recorded as an
+// entry without function, such that the next lookup does not try again.
+// Locked frames cannot get new bindings, but existing ones which were skipped
+// can be assigned a function later, they are validated on every lookup.
+static void cacheFun(SEXP sym, SEXP start, SEXP fun) {
+    FunCacheBinding skipped[FUN_CACHE_MAX_SKIPPED];
+    size_t numSkipped = 0;
+    for (SEXP rho = start; TYPEOF(rho) == ENVSXP && rho != R_GlobalEnv;
+         rho = ENCLOS(rho)) {
+        SEXP cell = nullptr;
+        if (!isBaseEnv(rho)) {
+            if (!FRAME_IS_LOCKED(rho))
+                break;
+            R_varloc_t loc = R_findVarLocInFrame(rho, sym);
+            if (R_VARLOC_IS_NULL(loc))
+                continue;
+            if (IS_ACTIVE_BINDING(loc.cell))
+                break;
+            cell = loc.cell;
+        }
+        FunCacheBinding binding = {cell, bindingValue(cell, sym)};
+        if (binding.value != R_UnboundValue) {
+            SEXP value = TYPEOF(binding.value) == PROMSXP
+                             ? PRVALUE(binding.value)
+                             : binding.value;
+            if (value == fun) {
+                store(sym, start, binding, skipped, numSkipped, fun);
+                return;
+            }
+            // Rf_findFun skips bindings which are not functions
+            if (TYPEOF(value) == CLOSXP || TYPEOF(value) == BUILTINSXP ||
+                TYPEOF(value) == SPECIALSXP)
+                break;
+        }
+        // Skipped bindings can be assigned a function later. The base
+        // environments are not locked, there even an unbound symbol can
+        // become bound.
+        if (numSkipped == FUN_CACHE_MAX_SKIPPED)
+            break;
+        skipped[numSkipped++] = binding;
+    }
+    store(sym, start, {nullptr, R_NilValue}, nullptr, 0, nullptr);
+}
+
+SEXP cachedFindFun(SEXP sym, SEXP env) {
+    // Search the local frames, until the first locked environment
+    SEXP start = env;
+    while (TYPEOF(start) == ENVSXP && !isBaseEnv(start) &&
+           !FRAME_IS_LOCKED(start)) {
+        // The global environment and the search path can change at any time
+        if (start == R_GlobalEnv)
+            return Rf_findFun(sym, start);
+        if (!R_VARLOC_IS_NULL(R_findVarLocInFrame(start, sym)))
+            return Rf_findFun(sym, start);
+        start = ENCLOS(start);
+    }
+    if (TYPEOF(start) != ENVSXP)
+        return Rf_findFun(sym, start);
+
+    auto& e = funCache[funCacheSlot(sym, start)];
+    if (e.sym == sym && e.start == start) {
+        if (!e.fun)
+            return Rf_findFun(sym, start);
+        if (e.valid())
+            return e.fun;
+    }
+
+    SEXP fun = Rf_findFun(sym, start);
+    cacheFun(sym, start, fun);
+    return fun;
+}
+
+} // namespace rir
@@ -266,5 +266,16 @@ static inline void rirSetVarWrapper(SEXP sym, SEXP val, SEXP env) {
 }
 
 #endif
+
+/*
+ * Rf_findFun with a global cache of the lookups which end in locked
+ * environments, e.g. calls to base functions from package code. Local frames
+ * are still searched on every lookup, then (symbol, first locked environment)
+ * is looked up in the cache. Locked environments cannot gain bindings, thus
+ * an entry stays valid as long as the binding it was found in holds the same
+ * value.
+ */
+SEXP cachedFindFun(SEXP sym, SEXP env);
+
 } // namespace rir
 #endif
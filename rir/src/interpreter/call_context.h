@@ -62,6 +62,9 @@ struct CallContext {
     const SEXP callee;
     Context givenContext;
     SEXP arglist = nullptr;
+    // The arguments as supplied by the caller, if they were matched to the
+    // formals at runtime (see dotsArgmatchedCall)
+    SEXP suppliedArglist = nullptr;
 
     bool hasEagerCallee() const { return TYPEOF(callee) == BUILTINSXP; }
     bool hasNames() const { return names; }
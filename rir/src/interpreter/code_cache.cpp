@@ -0,0 +1,295 @@
+#include "code_cache.h"
+
+#include "R/Protect.h"
+#include "R/Serialize.h"
+#include "compiler/parameter.h"
+#include "interp_incl.h"
+#include "ir/BC.h"
+#include "runtime/DispatchTable.h"
+
+#include <Rversion.h>
+#include <cstdio>
+#include <cstring>
+#include <dlfcn.h>
+#include <sstream>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <unordered_set>
+
+#ifndef RIR_COMMIT
+#define RIR_COMMIT "unknown"
+#endif
+
+namespace rir {
+
+// Bump whenever the serialized format of rir objects changes
+static constexpr unsigned CODE_CACHE_FORMAT = 2;
+
+static const char* cacheDir = getenv("PIR_CODE_CACHE");
+
+bool CodeCache::enabled() { return cacheDir && *cacheDir; }
+
+namespace {
+
+// FNV-1a over the structure of an AST. Attributes (ie. srcrefs) are ignored.
+struct AstHash {
+    uint64_t value = 14695981039346656037ULL;
+
+    void add(const void* data, size_t size) {
+        auto bytes = (const uint8_t*)data;
+        for (size_t i = 0; i < size; ++i) {
+            value ^= bytes[i];
+            value *= 1099511628211ULL;
+        }
+    }
+    void add(int i) { add(&i, sizeof(i)); }
+    void add(const char* str) { add(str, strlen(str) + 1); }
+
+    // Returns false if the AST contains something which cannot be hashed in a
+    // process independent way, e.g. environments or closures.
+    bool add(SEXP s) {
+        add(TYPEOF(s));
+        switch (TYPEOF(s)) {
+        case NILSXP:
+            return true;
+        case SYMSXP:
+            add(CHAR(PRINTNAME(s)));
+            return true;
+        case CHARSXP:
+            if (s == NA_STRING)
+                add(-1);
+            else
+                add(CHAR(s));
+            return true;
+        case LISTSXP:
+        case LANGSXP:
+        case DOTSXP:
+            return add(TAG(s)) && add(CAR(s)) && add(CDR(s));
+        case LGLSXP:
+            add((int)XLENGTH(s));
+            add(LOGICAL(s), XLENGTH(s) * sizeof(int));
+            return true;
+        case INTSXP:
+            add((int)XLENGTH(s));
+            add(INTEGER(s), XLENGTH(s) * sizeof(int));
+            return true;
+        case REALSXP:
+            add((int)XLENGTH(s));
+            add(REAL(s), XLENGTH(s) * sizeof(double));
+            return true;
+        case CPLXSXP:
+            add((int)XLENGTH(s));
+            add(COMPLEX(s), XLENGTH(s) * sizeof(Rcomplex));
+            return true;
+        case RAWSXP:
+            add((int)XLENGTH(s));
+            add(RAW(s), XLENGTH(s));
+            return true;
+        case STRSXP:
+            add((int)XLENGTH(s));
+            for (R_xlen_t i = 0; i < XLENGTH(s); ++i)
+                add(STRING_ELT(s, i));
+            return true;
+        case VECSXP:
+        case EXPRSXP:
+            add((int)XLENGTH(s));
+            for (R_xlen_t i = 0; i < XLENGTH(s); ++i)
+                if (!add(VECTOR_ELT(s, i)))
+                    return false;
+            return true;
+        default:
+            return false;
+        }
+    }
+};
+
+} // namespace
+
+// Entries are only valid for the build of rir and R which wrote them. The
+// commit does not change on local modifications, thus the modification time
+// of the rir library is part of the key too.
+static AstHash buildHash() {
+    AstHash hash;
+    hash.add(RIR_COMMIT);
+    Dl_info info;
+    struct stat st;
+    if (dladdr((void*)&CodeCache::enabled, &info) && info.dli_fname &&
+        stat(info.dli_fname, &st) == 0)
+        hash.add(&st.st_mtime, sizeof(st.st_mtime));
+    hash.add(R_VERSION);
+    hash.add(R_STATUS);
+    return hash;
+}
+
+static bool cacheKey(SEXP closure, SEXP ast, uint64_t& key) {
+    static const AstHash build = buildHash();
+    AstHash hash = build;
+
+    // Only closures defined at the top level of a namespace (or the global
+    // env) are cached. The package version is part of the key, thus updating
+    // a package invalidates its entries.
+    auto env = CLOENV(closure);
+    if (env == R_GlobalEnv) {
+        hash.add("R_GlobalEnv");
+    } else if (env == R_BaseEnv || env == R_BaseNamespace) {
+        hash.add("base");
+    } else if (R_IsNamespaceEnv(env)) {
+        if (!hash.add(R_NamespaceEnvSpec(env)))
+            return false;
+    } else {
+        return false;
+    }
+
+    if (!hash.add(FORMALS(closure)) || !hash.add(ast))
+        return false;
+    key = hash.value;
+    return true;
+}
+
+static std::string entryPath(uint64_t key) {
+    std::stringstream path;
+    path << cacheDir << "/" << std::hex << key << ".v" << std::dec
+         << CODE_CACHE_FORMAT << ".rir";
+    return path.str();
+}
+
+static void collectCodes(Code* c, std::unordered_set<Code*>& codes) {
+    if (!codes.insert(c).second)
+        return;
+    for (unsigned i = 0; i < c->extraPoolSize; ++i)
+        if (auto p = Code::check(c->getExtraPoolEntry(i)))
+            collectCodes(p, codes);
+}
+
+static void collectCodes(Function* f, std::unordered_set<Code*>& codes) {
+    collectCodes(f->body(), codes);
+    for (size_t i = 0; i < f->nargs(); ++i)
+        if (auto a = f->defaultArg(i))
+            collectCodes(a, codes);
+}
+
+// Deopt metadata refers to baseline code by uid. We can only restore versions
+// where all of those are part of the baseline stored in the same entry, which
+// is not the case if code of other closures got inlined.
+static bool selfContained(DispatchTable* table) {
+    std::unordered_set<Code*> baseline;
+    collectCodes(table->baseline(), baseline);
+    for (size_t i = 1; i < table->size(); ++i) {
+        std::unordered_set<Code*> codes;
+        collectCodes(table->get(i), codes);
+        for (auto c : codes) {
+            for (auto pc = c->code(); pc < c->endCode(); pc = BC::next(pc)) {
+                auto bc = BC::decode(pc, c);
+                if (bc.bc == Opcode::deopt_) {
+                    auto m = (DeoptMetadata*)DATAPTR(
+                        Pool::get(bc.immediate.pool));
+                    for (size_t j = 0; j < m->numFrames; ++j)
+                        if (!baseline.count(m->frames[j].code))
+                            return false;
+                } else if (bc.bc == Opcode::record_deopt_) {
+                    if (!baseline.count(bc.immediate.deoptReason.srcCode))
+                        return false;
+                }
+            }
+        }
+    }
+    return true;
+}
+
+void CodeCache::store(SEXP closure) {
+    if (!enabled())
+        return;
+    auto table = DispatchTable::check(BODY(closure));
+    if (!table || table->size() < 2 || !selfContained(table))
+        return;
+    auto ast = src_pool_at(globalContext(), table->baseline()->body()->src);
+    uint64_t key;
+    if (!cacheKey(closure, ast, key))
+        return;
+
+    // Other processes might be reading the entry, write it to a temporary file
+    // first and then move it into place.
+    auto path = entryPath(key);
+    std::stringstream tmp;
+    tmp << path << "." << getpid();
+    FILE* file = fopen(tmp.str().c_str(), "w");
+    if (file == NULL)
+        return;
+
+    Protect p;
+    SEXP entry = p(Rf_allocVector(VECSXP, 2));
+    SET_VECTOR_ELT(entry, 0, FORMALS(closure));
+    SET_VECTOR_ELT(entry, 1, table->container());
+
+    // Like load, a failure (e.g. a full disk or an object which cannot be
+    // serialized) must not raise an error from within the compiler.
+    struct Store {
+        FILE* file;
+        SEXP entry;
+    } st = {file, entry};
+    auto oldPreserve = pir::Parameter::RIR_PRESERVE;
+    pir::Parameter::RIR_PRESERVE = true;
+    bool ok = R_ToplevelExec(
+        [](void* data) {
+            auto st = (Store*)data;
+            R_SaveToFile(st->entry, st->file, 0);
+        },
+        &st);
+    pir::Parameter::RIR_PRESERVE = oldPreserve;
+    if (fclose(file) != 0)
+        ok = false;
+    if (ok)
+        ok = rename(tmp.str().c_str(), path.c_str()) == 0;
+    if (!ok)
+        remove(tmp.str().c_str());
+}
+
+bool CodeCache::load(SEXP closure, SEXP ast) {
+    if (!enabled())
+        return false;
+    uint64_t key;
+    if (!cacheKey(closure, ast, key))
+        return false;
+    FILE* file = fopen(entryPath(key).c_str(), "r");
+    if (file == NULL)
+        return false;
+
+    // Every load of an entry gets its own copy of the code, thus it needs
+    // fresh uids. A corrupt entry is ignored instead of raising an error.
+    struct Load {
+        FILE* file;
+        SEXP entry;
+    } l = {file, R_NilValue};
+    auto oldPreserve = pir::Parameter::RIR_PRESERVE;
+    pir::Parameter::RIR_PRESERVE = true;
+    Code::beginFreshUids();
+    bool ok = R_ToplevelExec(
+        [](void* data) {
+            auto l = (Load*)data;
+            l->entry = R_LoadFromFile(l->file, 0);
+        },
+        &l);
+    Code::endFreshUids();
+    pir::Parameter::RIR_PRESERVE = oldPreserve;
+    fclose(file);
+    if (!ok)
+        return false;
+
+    Protect p;
+    SEXP entry = p(l.entry);
+    if (TYPEOF(entry) != VECSXP || Rf_length(entry) != 2 ||
+        !R_compute_identical(VECTOR_ELT(entry, 0), FORMALS(closure), 16))
+        return false;
+    auto table = DispatchTable::check(VECTOR_ELT(entry, 1));
+    if (!table)
+        return false;
+    // The key is only a hash, the entry must be for the same source
+    auto cachedAst =
+        src_pool_at(globalContext(), table->baseline()->body()->src);
+    if (!R_compute_identical(cachedAst, ast, 16))
+        return false;
+    SET_BODY(closure, table->container());
+    return true;
+}
+
+} // namespace rir
@@ -0,0 +1,36 @@
+#ifndef RIR_CODE_CACHE_H
+#define RIR_CODE_CACHE_H
+
+#include "R/r.h"
+
+namespace rir {
+
+/*
+ * Persistent cache of optimized dispatch tables, enabled by pointing
+ * PIR_CODE_CACHE to a directory.
+ *
+ * Entries are keyed by a structural hash of the closure source (formals and
+ * body), its defining namespace (including the package version), the
+ * serialization format version and the build of rir and R. An entry holds the
+ * whole dispatch table, such that the uids referenced by deopt metadata
+ * resolve to the baseline code stored alongside. Loaded code gets fresh uids.
+ * Since the key is only a hash, an entry is only installed if its formals and
+ * body are identical to the closure's. Native code contains raw heap addresses
+ * and is not persisted, cached versions run their PIR generated bytecode until
+ * they are reoptimized.
+ */
+struct CodeCache {
+    static bool enabled();
+
+    // Writes the dispatch table of a compiled closure to the cache. Best
+    // effort, closures which cannot be cached are silently skipped.
+    static void store(SEXP closure);
+
+    // If there is an entry for this (not yet rir compiled) closure with the
+    // given body, installs the cached dispatch table and returns true.
+    static bool load(SEXP closure, SEXP ast);
+};
+
+} // namespace rir
+
+#endif
@@ -47,6 +47,8 @@ InterpreterInstance* context_create() {
         return rir_compile(closure, R_NilValue);
     };
     c->closureOptimizer = [](SEXP f, const Context&, SEXP n) { return f; };
+    c->continuationOptimizer = [](SEXP, Opcode*, const R_bcstack_t*, size_t,
+                                  SEXP) { return (Function*)nullptr; };
 
     if (pir && std::string(pir).compare("off") == 0) {
         // do nothing; use defaults
@@ -62,6 +64,7 @@ InterpreterInstance* context_create() {
         };
     } else {
         c->closureOptimizer = rirOptDefaultOpts;
+        c->continuationOptimizer = rirOptContinuation;
     }
 
     return c;
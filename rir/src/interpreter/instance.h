@@ -27,6 +27,14 @@ typedef std::function<SEXP(SEXP closure, SEXP name)> ClosureCompiler;
 typedef std::function<SEXP(SEXP closure, const rir::Context& assumptions,
                            SEXP name)>
     ClosureOptimizer;
+/** Compiles the rest of an invocation of the closure, which is interrupted at
+  pc with stackSize values on the operand stack starting at stack. Returns
+  nullptr if that is not possible.
+ */
+typedef std::function<Function*(SEXP closure, Opcode* pc,
+                                 const R_bcstack_t* stack, size_t stackSize,
+                                 SEXP name)>
+    ContinuationOptimizer;
 
 #define POOL_CAPACITY 4096
 #define STACK_CAPACITY 4096
@@ -62,6 +70,7 @@ struct InterpreterInstance {
     ExprCompiler exprCompiler;
     ClosureCompiler closureCompiler;
     ClosureOptimizer closureOptimizer;
+    ContinuationOptimizer continuationOptimizer;
 };
 
 // TODO we might actually need to do more for the lengths (i.e. true length vs
@@ -444,7 +444,71 @@ void checkUserInterrupt() {
     }
 }
 
+// Reason recorded by the record_deopt_ preceding the current deopt, to be
+// attributed to the deoptimizing version by registerDeoptReason.
+static DeoptReason lastDeoptReason = {DeoptReason::None, nullptr, 0};
+
+// Stop speculating on the feedback at the origin of the reason. For dead
+// branches and materialized env stubs recordDeoptReason already makes the
+// speculation impossible.
+static void disableSpeculation(const DeoptReason& reason) {
+    Opcode* pos = (Opcode*)reason.srcCode + reason.originOffset;
+    switch (reason.reason) {
+    case DeoptReason::Typecheck: {
+        assert(*pos == Opcode::record_type_);
+        ObservedValues* feedback = (ObservedValues*)(pos + 1);
+        feedback->speculationDisabled = true;
+        break;
+    }
+    case DeoptReason::Calltarget: {
+        assert(*pos == Opcode::record_call_);
+        ObservedCallees* feedback = (ObservedCallees*)(pos + 1);
+        feedback->speculationDisabled = true;
+        break;
+    }
+    case DeoptReason::EnvStubMaterialized:
+    case DeoptReason::DeadBranchReached:
+        break;
+    case DeoptReason::None:
+        assert(false);
+        break;
+    }
+}
+
+void registerDeoptReason(Code* c, SEXP cls) {
+    auto reason = lastDeoptReason;
+    lastDeoptReason.reason = DeoptReason::None;
+    if (reason.reason == DeoptReason::None || !cls)
+        return;
+    auto dt = DispatchTable::check(BODY(cls));
+    if (!dt)
+        return;
+    for (size_t i = 1; i < dt->size(); ++i) {
+        if (dt->get(i)->body() == c) {
+            dt->get(i)->registerDeoptReason(reason.reason);
+            break;
+        }
+    }
+    // The deoptimized version is about to be removed, the baseline keeps the
+    // history of the whole closure (like its deoptCount).
+    auto baseline = dt->baseline();
+    baseline->registerDeoptReason(reason.reason);
+
+    // Deopt policy: if the same site keeps deoptimizing, the feedback is not
+    // converging (e.g. more types or targets than it can record). Instead of
+    // eventually abandoning the whole closure, the next version is compiled
+    // without this particular speculation.
+    auto& site = baseline->deoptHistory().site(reason);
+    site.count++;
+    if (pir::Parameter::DEOPT_RESPECIALIZE &&
+        site.count >= pir::Parameter::DEOPT_RESPECIALIZE) {
+        disableSpeculation(reason);
+        baseline->deoptHistory().forgive(site);
+    }
+}
+
 void recordDeoptReason(SEXP val, const DeoptReason& reason) {
+    lastDeoptReason = reason;
     Opcode* pos = (Opcode*)reason.srcCode + reason.originOffset;
     switch (reason.reason) {
     case DeoptReason::DeadBranchReached: {
@@ -785,9 +849,90 @@ unsigned pir::Parameter::RIR_WARMUP =
     getenv("PIR_WARMUP") ? atoi(getenv("PIR_WARMUP")) : 3;
 unsigned pir::Parameter::DEOPT_ABANDON =
     getenv("PIR_DEOPT_ABANDON") ? atoi(getenv("PIR_DEOPT_ABANDON")) : 10;
+unsigned pir::Parameter::DEOPT_RESPECIALIZE =
+    getenv("PIR_DEOPT_RESPECIALIZE") ? atoi(getenv("PIR_DEOPT_RESPECIALIZE"))
+                                     : 3;
+unsigned pir::Parameter::PIR_OSR =
+    getenv("PIR_OSR") ? atoi(getenv("PIR_OSR")) : 0;
 
 static unsigned serializeCounter = 0;
 
+// Matching the arguments at runtime is expensive. It is only worth it if the
+// callee has optimized versions, or if this call triggers its compilation (see
+// RecompileHeuristic).
+static bool needsDotsArgmatch(const CallContext& call, DispatchTable* table) {
+    auto baseline = table->baseline();
+    if (call.arglist ||
+        call.givenContext.includes(Assumption::StaticallyArgmatched) ||
+        !baseline->signature().hasDotsFormals ||
+        baseline->flags.contains(Function::NotOptimizable))
+        return false;
+    if (table->size() > 1 || baseline->flags.contains(Function::MarkOpt))
+        return true;
+    return baseline->unforgivenDeoptCount() < pir::Parameter::DEOPT_ABANDON &&
+           (baseline->invocationCount() + 1) %
+                   (baseline->deoptCount() + pir::Parameter::RIR_WARMUP) ==
+               0;
+}
+
+RIR_INLINE SEXP rirCall(CallContext& call, InterpreterInstance* ctx);
+
+// Matched calls to the baseline per matched call to optimized code tolerated
+static constexpr unsigned DotsArgmatchWasteRatio = 4;
+
+// Optimized versions of closures with `...` expect one argument per formal,
+// the `...` list passed as DOTSXP. If the caller could not match the arguments
+// statically, we do it here and call with the matched arguments.
+static SEXP dotsArgmatchedCall(CallContext& call, InterpreterInstance* ctx) {
+    SEXP op = call.callee;
+    SEXP arglist = createLegacyLazyArgsList(call, ctx);
+    PROTECT(arglist);
+
+    // Set up a context with the call in it so errors have access to it
+    RCNTXT cntxt;
+    initClosureContext(call.ast, &cntxt, CLOENV(op), call.callerEnv, arglist,
+                       op);
+    SEXP matched = Rf_matchArgs(FORMALS(op), arglist, call.ast);
+    PROTECT(matched);
+    endClosureContext(&cntxt, R_NilValue);
+
+    size_t nargs = 0;
+    for (SEXP a = matched; a != R_NilValue; a = CDR(a)) {
+        ostack_push(ctx, CAR(a));
+        nargs++;
+    }
+
+    // The static information about the supplied arguments does not apply to
+    // the matched ones
+    Context given;
+    given.add(Assumption::StaticallyArgmatched);
+    CallContext matchedCall(const_cast<Code*>(call.caller), op, nargs,
+                            call.ast, ostack_cell_at(ctx, nargs - 1), nullptr,
+                            call.callerEnv, given, ctx);
+    matchedCall.suppliedArglist = arglist;
+
+    auto table = DispatchTable::unpack(BODY(op));
+    auto baseline = table->baseline();
+    inferCurrentContext(matchedCall, baseline->signature().formalNargs(), ctx);
+    bool inBaseline = dispatch(matchedCall, table) == baseline;
+    auto versions = table->size();
+
+    auto res = rirCall(matchedCall, ctx);
+    ostack_popn(ctx, matchedCall.passedArgs);
+    UNPROTECT(2);
+
+    // The matching is paid back only if the call runs optimized code or
+    // compiles some. If most matched calls end up in the baseline anyway
+    // (e.g. the versions assume argument types these callers do not pass),
+    // the closure goes back to being unoptimizable for unmatched callers.
+    baseline->registerDotsArgmatch(inBaseline && table->size() == versions);
+    auto stats = baseline->stats();
+    if (stats->argmatchWasted >= pir::Parameter::RIR_WARMUP &&
+        stats->argmatchWasted > DotsArgmatchWasteRatio * stats->argmatchUsed)
+        baseline->flags.set(Function::NotOptimizable);
+    return res;
+}
+
 // Call a RIR function. Arguments are still untouched.
 RIR_INLINE SEXP rirCall(CallContext& call, InterpreterInstance* ctx) {
     SEXP body = BODY(call.callee);
@@ -805,13 +950,30 @@ RIR_INLINE SEXP rirCall(CallContext& call, InterpreterInstance* ctx) {
 
     auto table = DispatchTable::unpack(body);
 
+    if (needsDotsArgmatch(call, table)) {
+        auto res = dotsArgmatchedCall(call, ctx);
+        if (bodyPreserved)
+            UNPROTECT(1);
+        return res;
+    }
+
+    // Safe point to pick up native code from the background compiler
+    if (pir::Parameter::PIR_ASYNC_COMPILE)
+        pir::JitQueue::installFinished();
+
     inferCurrentContext(call, table->baseline()->signature().formalNargs(),
                         ctx);
     Function* fun = dispatch(call, table);
     fun->registerInvocation();
+    TierUpNative(fun);
 
     auto flags = fun->flags;
-    if (!isDeoptimizing() && RecompileHeuristic(table, fun)) {
+    // While the background compiler is busy we keep running the current
+    // version, the heuristic will trigger again later.
+    bool compilerAvailable =
+        !pir::Parameter::PIR_ASYNC_COMPILE || !pir::JitQueue::busy();
+    if (!isDeoptimizing() && compilerAvailable &&
+        RecompileHeuristic(table, fun)) {
         Context given = call.givenContext;
         // addDynamicAssumptionForOneTarget compares arguments with the
         // signature of the current dispatch target. There the number of
@@ -880,8 +1042,10 @@ RIR_INLINE SEXP rirCall(CallContext& call, InterpreterInstance* ctx) {
                             SET_FRAME(env, a);
                         }
                     } else if (CAR(a) == R_MissingArg) {
-                        if (auto dflt = fun->defaultArg(pos))
+                        if (auto dflt = fun->defaultArg(pos)) {
                             SETCAR(a, createPromise(dflt, env));
+                            SET_MISSING(a, 2);
+                        }
                     }
 
                     f = CDR(f);
@@ -894,7 +1058,9 @@ RIR_INLINE SEXP rirCall(CallContext& call, InterpreterInstance* ctx) {
             // Currently we cannot recreate the original arglist if we
             // statically reordered arguments. TODO this needs to be fixed
             // by remembering the original order.
-            if (auto a = ArgsLazyDataContent::check(arglist))
+            if (call.suppliedArglist)
+                arglist = call.suppliedArglist;
+            else if (auto a = ArgsLazyDataContent::check(arglist))
                 a->args = nullptr;
             else
                 arglist = symbol::delayedArglist;
@@ -916,7 +1082,10 @@ RIR_INLINE SEXP rirCall(CallContext& call, InterpreterInstance* ctx) {
             // Currently we cannot recreate the original arglist if we
             // statically reordered arguments. TODO this needs to be fixed
             // by remembering the original order.
-            if (call.givenContext.includes(Assumption::StaticallyArgmatched))
+            if (call.suppliedArglist)
+                arglist = call.suppliedArglist;
+            else if (call.givenContext.includes(
+                         Assumption::StaticallyArgmatched))
                 lazyArgs.content.args = nullptr;
             supplyMissingArgs(call, fun);
             result = rirCallTrampoline(call, fun, arglist, ctx);
@@ -1388,6 +1557,29 @@ static R_INLINE int R_integer_uminus(int x, Rboolean* pnaflag) {
         BINOP_FALLBACK(#op);                                                   \
     } while (false)
 
+// Longer ranges of the interpreter are not materialized. Short ones stay plain
+// vectors, since they are cheap and the fast paths can access them directly.
+// Native code always materializes (see seq_int), its fast paths do not read
+// ALTREP vectors.
+static constexpr int COMPACT_RANGE_MIN_LENGTH = 64;
+
+// The compact sequences of GNU R are not exported, but its `:` builtin
+// returns one for integer bounds.
+static SEXP compactRange(int n1, int n2) {
+    static SEXP prim = NULL;
+    static CCODE blt;
+    if (!prim) {
+        prim = Rf_findFun(Rf_install(":"), R_BaseEnv);
+        blt = getBuiltin(prim);
+    }
+    SEXP from = PROTECT(Rf_ScalarInteger(n1));
+    SEXP to = PROTECT(Rf_ScalarInteger(n2));
+    SEXP args = PROTECT(Rf_list2(from, to));
+    SEXP res = blt(R_NilValue, prim, args, R_BaseEnv);
+    UNPROTECT(3);
+    return res;
+}
+
 SEXP seq_int(int n1, int n2) {
     int n = n1 <= n2 ? n2 - n1 + 1 : n1 - n2 + 1;
     SEXP ans = Rf_allocVector(INTSXP, n);
@@ -1404,6 +1596,13 @@ SEXP seq_int(int n1, int n2) {
     return ans;
 }
 
+static SEXP compactSeq_int(int n1, int n2) {
+    int n = n1 <= n2 ? n2 - n1 + 1 : n1 - n2 + 1;
+    if (n >= COMPACT_RANGE_MIN_LENGTH)
+        return compactRange(n1, n2);
+    return seq_int(n1, n2);
+}
+
 bool isMissing(SEXP symbol, SEXP environment, Code* code, Opcode* pc) {
     SEXP val = R_findVarLocInFrame(environment, symbol).cell;
     if (val == NULL) {
@@ -1794,6 +1993,51 @@ SEXP colonCastRhs(SEXP newLhs, SEXP rhs) {
     return result;
 }
 
+// On-stack replacement is only done in the baseline code of a closure, when it
+// runs from the start in its own environment.
+static bool osrCandidate(Code* c, SEXP env, const CallContext* callCtxt) {
+    if (!pir::Parameter::PIR_OSR || c->flags.contains(Code::NoOsr))
+        return false;
+    if (!callCtxt || !callCtxt->callee || TYPEOF(env) != ENVSXP)
+        return false;
+    auto table = DispatchTable::check(BODY(callCtxt->callee));
+    return table && table->baseline()->body() == c;
+}
+
+// Compiles the rest of the invocation from the loop header pc on and runs it.
+// The values on the operand stack above stackBase are passed as arguments, the
+// environment is the closure environment of a copy of the callee. Returns
+// nullptr if the continuation cannot be compiled.
+static SEXP osr(Code* c, Opcode* pc, InterpreterInstance* ctx, SEXP env,
+                const CallContext* callCtxt, size_t stackBase) {
+    size_t n = ostack_length(ctx) - stackBase;
+    R_bcstack_t* args = R_BCNodeStackTop - n;
+    SEXP name = TYPEOF(callCtxt->ast) == LANGSXP ? CAR(callCtxt->ast)
+                                                  : R_NilValue;
+    auto fun =
+        ctx->continuationOptimizer(callCtxt->callee, pc, args, n, name);
+    if (!fun) {
+        c->flags.set(Code::NoOsr);
+        return nullptr;
+    }
+    PROTECT(fun->container());
+    DispatchTable::unpack(BODY(callCtxt->callee))
+        ->baseline()
+        ->registerOsrEntry();
+
+    SEXP cls = Rf_allocSExp(CLOSXP);
+    SET_FORMALS(cls, FORMALS(callCtxt->callee));
+    SET_BODY(cls, BODY(callCtxt->callee));
+    SET_CLOENV(cls, env);
+    PROTECT(cls);
+
+    CallContext call(c, cls, n, callCtxt->ast, args, nullptr,
+                     callCtxt->callerEnv, Context(), ctx);
+    SEXP res = evalRirCode(fun->body(), ctx, symbol::delayedEnv, &call);
+    UNPROTECT(2);
+    return res;
+}
+
 SEXP evalRirCode(Code* c, InterpreterInstance* ctx, SEXP env,
                  const CallContext* callCtxt, Opcode* initialPC,
                  R_bcstack_t* localsBase, BindingCache* cache) {
@@ -1859,6 +2103,11 @@ SEXP evalRirCode(Code* c, InterpreterInstance* ctx, SEXP env,
     }
     SEXP res;
 
+    // Backwards jumps taken by this invocation, see PIR_OSR
+    bool osrEnabled = !initialPC && osrCandidate(c, env, callCtxt);
+    unsigned backEdges = 0;
+    size_t osrStackBase = ostack_length(ctx);
+
     auto changeEnv = [&](SEXP e) {
         assert((TYPEOF(e) == ENVSXP || LazyEnvironment::check(e)) &&
                "Expected an environment");
@@ -2097,7 +2346,7 @@ SEXP evalRirCode(Code* c, InterpreterInstance* ctx, SEXP env,
         INSTRUCTION(ldfun_) {
             SEXP sym = readConst(ctx, readImmediate());
             advanceImmediate();
-            res = Rf_findFun(sym, env);
+            res = cachedFindFun(sym, env);
 
             // TODO something should happen here
             if (res == R_UnboundValue)
@@ -3504,6 +3753,15 @@ SEXP evalRirCode(Code* c, InterpreterInstance* ctx, SEXP env,
             checkUserInterrupt();
             pc += offset;
             PC_BOUNDSCHECK(pc, c);
+            if (offset < 0 && osrEnabled &&
+                ++backEdges == pir::Parameter::PIR_OSR) {
+                // The continuation finishes the invocation
+                if ((res = osr(c, pc, ctx, env, callCtxt, osrStackBase))) {
+                    ostack_popn(ctx, ostack_length(ctx) - osrStackBase);
+                    ostack_push(ctx, res);
+                    goto eval_done;
+                }
+            }
             NEXT();
         }
 
@@ -3611,6 +3869,18 @@ SEXP evalRirCode(Code* c, InterpreterInstance* ctx, SEXP env,
             if (i >= XLENGTH(val) || i < 0)
                 goto fallback;
 
+            // Compact ranges (e.g. the sequence of a for loop) are not
+            // expanded by reading single elements
+            if (ALTREP(val)) {
+                if (TYPEOF(val) != INTSXP)
+                    goto fallback;
+                res = Rf_ScalarInteger(INTEGER_ELT(val, i));
+                ostack_popn(ctx, 2);
+                ostack_push(ctx, res);
+                R_Visible = (Rboolean) true;
+                NEXT();
+            }
+
             switch (TYPEOF(val)) {
 
 #define SIMPLECASE(vectype, vecaccess)                                         \
@@ -4047,7 +4317,7 @@ SEXP evalRirCode(Code* c, InterpreterInstance* ctx, SEXP env,
             res = readConst(ctx, readImmediate());
             advanceImmediate();
             advanceImmediate();
-            if (res != Rf_findFun(sym, env))
+            if (res != cachedFindFun(sym, env))
                 Rf_error("Invalid Callee");
             NEXT();
         }
@@ -4058,6 +4328,7 @@ SEXP evalRirCode(Code* c, InterpreterInstance* ctx, SEXP env,
             assert(TYPEOF(r) == RAWSXP);
             assert(XLENGTH(r) >= (int)sizeof(DeoptMetadata));
             auto m = (DeoptMetadata*)DATAPTR(r);
+            registerDeoptReason(c, callCtxt->callee);
 
 #if 0
             std::cout << "\n## ====================\n";
@@ -4110,13 +4381,13 @@ SEXP evalRirCode(Code* c, InterpreterInstance* ctx, SEXP env,
                 if (IS_SIMPLE_SCALAR(rhs, INTSXP)) {
                     int to = *INTEGER(rhs);
                     if (from != NA_INTEGER && to != NA_INTEGER) {
-                        res = seq_int(from, to);
+                        res = compactSeq_int(from, to);
                     }
                 } else if (IS_SIMPLE_SCALAR(rhs, REALSXP)) {
                     double to = *REAL(rhs);
                     if (from != NA_INTEGER && to != NA_REAL && R_FINITE(to) &&
                         INT_MIN <= to && INT_MAX >= to && to == (int)to) {
-                        res = seq_int(from, (int)to);
+                        res = compactSeq_int(from, (int)to);
                     }
                 }
             } else if (IS_SIMPLE_SCALAR(lhs, REALSXP)) {
@@ -4126,7 +4397,7 @@ SEXP evalRirCode(Code* c, InterpreterInstance* ctx, SEXP env,
                     if (from != NA_REAL && to != NA_INTEGER && R_FINITE(from) &&
                         INT_MIN <= from && INT_MAX >= from &&
                         from == (int)from) {
-                        res = seq_int((int)from, to);
+                        res = compactSeq_int((int)from, to);
                     }
                 } else if (IS_SIMPLE_SCALAR(rhs, REALSXP)) {
                     double to = *REAL(rhs);
@@ -4134,7 +4405,7 @@ SEXP evalRirCode(Code* c, InterpreterInstance* ctx, SEXP env,
                         R_FINITE(to) && INT_MIN <= from && INT_MAX >= from &&
                         INT_MIN <= to && INT_MAX >= to && from == (int)from &&
                         to == (int)to) {
-                        res = seq_int((int)from, (int)to);
+                        res = compactSeq_int((int)from, (int)to);
                     }
                 }
             }
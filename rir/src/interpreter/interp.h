@@ -5,6 +5,7 @@
 #include "call_context.h"
 #include "instance.h"
 
+#include "compiler/native/jit_queue.h"
 #include "compiler/parameter.h"
 #include "interp_incl.h"
 #include "ir/Deoptimization.h"
@@ -48,20 +49,26 @@ inline RCNTXT* findFunctionContextFor(SEXP e) {
     return nullptr;
 }
 
+// The heuristic for the given number of invocations of fun
 inline bool RecompileHeuristic(DispatchTable* table, Function* fun,
-                               unsigned factor = 1) {
+                               unsigned factor, size_t invocations) {
     auto& flags = fun->flags;
     return (!flags.contains(Function::NotOptimizable) &&
             (flags.contains(Function::MarkOpt) ||
              flags.contains(Function::Dead) ||
-             (fun->deoptCount() < pir::Parameter::DEOPT_ABANDON &&
-              ((fun != table->baseline() && fun->invocationCount() >= 2 &&
-                fun->invocationCount() <= pir::Parameter::RIR_WARMUP) ||
-               (fun->invocationCount() %
+             (fun->unforgivenDeoptCount() < pir::Parameter::DEOPT_ABANDON &&
+              ((fun != table->baseline() && invocations >= 2 &&
+                invocations <= pir::Parameter::RIR_WARMUP) ||
+               (invocations %
                 (factor * (fun->deoptCount() + pir::Parameter::RIR_WARMUP))) ==
                    0))));
 }
 
+inline bool RecompileHeuristic(DispatchTable* table, Function* fun,
+                               unsigned factor = 1) {
+    return RecompileHeuristic(table, fun, factor, fun->invocationCount());
+}
+
 inline bool RecompileCondition(DispatchTable* table, Function* fun,
                                const Context& context) {
     return (fun->flags.contains(Function::MarkOpt) ||
@@ -70,6 +77,32 @@ inline bool RecompileCondition(DispatchTable* table, Function* fun,
             fun->body()->flags.contains(Code::Reoptimise));
 }
 
+// Native code of hot versions is recompiled with the full LLVM pipeline, see
+// PIR_LLVM_TIER_UP
+inline bool NeedsTierUp(Function* fun, size_t invocations) {
+    return fun->body()->flags.contains(Code::NativeTierUp) &&
+           invocations >= pir::Parameter::PIR_LLVM_TIER_UP;
+}
+
+inline void TierUpNative(Function* fun) {
+    if (NeedsTierUp(fun, fun->invocationCount()))
+        pir::JitQueue::tierUp(fun->body());
+}
+
+// Native code calls fun directly as long as fun->body()->directCalls is not
+// zero, without counting the invocation through the trampoline. This returns
+// how many of the calls following the current one can do so, before the
+// trampoline needs to run the heuristics above again.
+inline unsigned DirectCallBudget(DispatchTable* table, Function* fun) {
+    static constexpr unsigned MaxBudget = 1024;
+    auto invocations = fun->invocationCount();
+    for (unsigned k = 1; k <= MaxBudget; ++k)
+        if (RecompileHeuristic(table, fun, 3, invocations + k) ||
+            NeedsTierUp(fun, invocations + k))
+            return k - 1;
+    return MaxBudget;
+}
+
 inline bool matches(const CallContext& call, Function* f) {
     return call.givenContext.smaller(f->context());
 }
@@ -93,6 +126,7 @@ void deoptFramesWithContext(InterpreterInstance* ctx,
                             size_t pos, size_t stackHeight,
                             RCNTXT* currentContext);
 void recordDeoptReason(SEXP val, const DeoptReason& reason);
+void registerDeoptReason(Code* c, SEXP cls);
 void jit(SEXP cls, SEXP name, InterpreterInstance* ctx);
 
 SEXP seq_int(int n1, int n2);
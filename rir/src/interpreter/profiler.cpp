@@ -28,44 +28,46 @@ namespace rir {
 static RuntimeProfiler instance;
 
 static volatile size_t samples = 0;
+static volatile size_t frames = 0;
 static volatile size_t hits = 0;
 static volatile size_t compilations = 0;
 
 RuntimeProfiler::RuntimeProfiler() {}
 
+unsigned RuntimeProfiler::epoch() { return samples / DecayPeriod; }
+
 RuntimeProfiler::~RuntimeProfiler() {}
 
+// We are in a signal handler, the slot iteration must not capture (and thus
+// allocate), that's why the state is static.
 static bool needReopt = false;
 static size_t goodValues = 0;
 static size_t slotCount = 0;
 static R_bcstack_t* stack;
 
-void RuntimeProfiler::sample(int signal) {
-    samples++;
-    auto ctx = (RCNTXT*)R_GlobalContext;
-    stack = ctx->nodestack;
-    if (R_BCNodeStackTop == R_BCNodeStackBase)
-        return;
-    if ((stack)->tag != 0)
-        return;
-    auto tos = (stack)->u.sxpval;
-    if (!tos)
-        return;
-    auto code = Code::check(tos);
-    if (!code)
-        return;
-    auto md = code->pirTypeFeedback();
-    if (!md)
-        return;
+SEXP RuntimeProfiler::nativeFrameMarker = nullptr;
 
+// The marker is allocated at startup, native code can be generated on a
+// worker thread which must not allocate
+static void initNativeFrameMarker() {
+    RuntimeProfiler::nativeFrameMarker = Rf_allocVector(RAWSXP, 0);
+    R_PreserveObject(RuntimeProfiler::nativeFrameMarker);
+}
+
+// stack points to the marker of a native frame, the PirTypeFeedback slots
+// refer to the cells of the frame relative to it.
+static void sampleFrame(Code* code, PirTypeFeedback* md) {
     hits++;
     needReopt = false;
     goodValues = 0;
     slotCount = 0;
 
     md->forEachSlot([](size_t i, PirTypeFeedback::MDEntry& mdEntry) {
+        if (stack + i >= R_BCNodeStackTop)
+            return;
         auto slot = *(stack + i);
-        assert(slot.tag == 0);
+        if (slot.tag != 0)
+            return;
         if (auto sxpval = slot.u.sxpval) {
             mdEntry.feedback.record(sxpval);
             auto samples = ++(mdEntry.sampleCount);
@@ -103,15 +105,35 @@ void RuntimeProfiler::sample(int signal) {
     }
 }
 
+void RuntimeProfiler::sample(int signal) {
+    samples++;
+    auto now = epoch();
+    // Walk all native frames on the stack, not just the innermost one. Every
+    // frame gets a sample, which builds the (inclusive) hotness profile used
+    // by the inliner, and gets its slot feedback updated.
+    for (stack = R_BCNodeStackBase; stack + 1 < R_BCNodeStackTop; ++stack) {
+        if (stack->tag != 0 || !RuntimeProfiler::nativeFrameMarker ||
+            stack->u.sxpval != RuntimeProfiler::nativeFrameMarker)
+            continue;
+        auto code = Code::unpack((stack + 1)->u.sxpval);
+        frames++;
+        code->registerSample(now);
+        if (auto md = code->pirTypeFeedback())
+            sampleFrame(code, md);
+    }
+}
+
 #ifndef __APPLE__
 static void handler(int signal) { instance.sample(signal); }
 
 static void dump() {
-    std::cout << "\nsamples: " << samples << ", hits: " << hits << "\n"
+    std::cout << "\nsamples: " << samples << ", frames: " << frames
+              << ", hits: " << hits << "\n"
               << "triggered " << compilations << " recompilations\n";
 }
 
 void RuntimeProfiler::initProfiler() {
+    initNativeFrameMarker();
     bool ENABLE_PROFILER = getenv("PIR_ENABLE_PROFILER") ? true : false;
     if (!ENABLE_PROFILER) {
         return;
@@ -164,7 +186,7 @@ void RuntimeProfiler::initProfiler() {
 }
 
 #else
-void RuntimeProfiler::initProfiler() {}
+void RuntimeProfiler::initProfiler() { initNativeFrameMarker(); }
 #endif
 
 } // namespace rir
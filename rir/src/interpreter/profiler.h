@@ -1,6 +1,8 @@
 #ifndef interpreter_profiler_h
 #define interpreter_profiler_h
 
+#include "R/r.h"
+
 namespace rir {
 
 class RuntimeProfiler {
@@ -10,6 +12,15 @@ class RuntimeProfiler {
     ~RuntimeProfiler();
     static void initProfiler();
     void sample(int);
+
+    // The sample counts of code objects are halved every DecayPeriod samples,
+    // such that code which is no longer hot stops looking hot
+    static constexpr size_t DecayPeriod = 1000;
+    static unsigned epoch();
+
+    // Native code starts its frame on the node stack with this marker,
+    // followed by its code object and its locals
+    static SEXP nativeFrameMarker;
 };
 
 } // namespace rir
@@ -270,6 +270,13 @@ void BC::deserialize(SEXP refTable, R_inpstream_t inp, Opcode* code,
                 i.assertTypeArgs.instr = -1;
             break;
         case Opcode::record_deopt_:
+            // The source code is referenced by pointer, which we need to
+            // translate the same way as the frames in the deopt metadata
+            i.deoptReason.reason = (DeoptReason::Reason)InInteger(inp);
+            i.deoptReason.srcCode =
+                Code::withUid(UUID::deserialize(refTable, inp));
+            i.deoptReason.originOffset = InInteger(inp);
+            break;
         case Opcode::record_call_:
         case Opcode::record_type_:
         case Opcode::record_test_:
@@ -412,6 +419,10 @@ void BC::serialize(SEXP refTable, R_outpstream_t out, const Opcode* code,
             }
             break;
         case Opcode::record_deopt_:
+            OutInteger(out, i.deoptReason.reason);
+            i.deoptReason.srcCode->uid.serialize(refTable, out);
+            OutInteger(out, i.deoptReason.originOffset);
+            break;
         case Opcode::record_call_:
         case Opcode::record_type_:
         case Opcode::record_test_:
@@ -656,7 +667,7 @@ void BC::print(std::ostream& out) const {
         break;
     case Opcode::record_call_: {
         ObservedCallees prof = immediate.callFeedback;
-        out << "[ ";
+        out << (prof.speculationDisabled ? "![ " : "[ ");
         if (prof.taken == ObservedCallees::CounterOverflow)
             out << "*, <";
         else
@@ -693,7 +704,7 @@ void BC::print(std::ostream& out) const {
     }
 
     case Opcode::record_type_: {
-        out << "[ ";
+        out << (immediate.typeFeedback.speculationDisabled ? "![ " : "[ ");
         printTypeFeedback(immediate.typeFeedback);
         out << " ]";
         break;
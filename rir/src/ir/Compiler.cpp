@@ -1407,6 +1407,8 @@ SEXP Compiler::finalize() {
             Code* compiled = compilePromise(ctx, *arg);
             function.addDefaultArg(compiled);
         }
+        if (arg.tag() == R_DotsSymbol)
+            signature.hasDotsFormals = true;
         signature.pushDefaultArgument();
     }
 
@@ -4,6 +4,7 @@
 #include "R/Preserve.h"
 #include "R/Protect.h"
 #include "R/r.h"
+#include "interpreter/code_cache.h"
 #include "runtime/DispatchTable.h"
 #include "utils/FunctionWriter.h"
 #include "utils/Pool.h"
@@ -103,6 +104,10 @@ class Compiler {
             body = VECTOR_ELT(CDR(body), 0);
         }
 
+        // Reuse optimized versions from an earlier session
+        if (CodeCache::load(inClosure, body))
+            return;
+
         Compiler c(body, FORMALS(inClosure), CLOENV(inClosure));
         SEXP compiledFun = p(c.finalize());
 
@@ -11,7 +11,27 @@
 namespace rir {
 std::unordered_map<UUID, Code*> allCodes;
 
-Code* Code::withUid(UUID uid) { return allCodes.at(uid); }
+// Serialized uid to fresh uid, while deserializing with fresh uids
+static std::unordered_map<UUID, UUID>* freshUids = nullptr;
+
+Code* Code::withUid(UUID uid) {
+    if (freshUids) {
+        auto fresh = freshUids->find(uid);
+        if (fresh != freshUids->end())
+            return allCodes.at(fresh->second);
+    }
+    return allCodes.at(uid);
+}
+
+void Code::beginFreshUids() {
+    assert(!freshUids);
+    freshUids = new std::unordered_map<UUID, UUID>;
+}
+
+void Code::endFreshUids() {
+    delete freshUids;
+    freshUids = nullptr;
+}
 
 // cppcheck-suppress uninitMemberVar symbol=data
 Code::Code(FunctionSEXP fun, unsigned src, unsigned cs, unsigned sourceLength,
@@ -21,10 +41,11 @@ Code::Code(FunctionSEXP fun, unsigned src, unsigned cs, unsigned sourceLength,
           (intptr_t)&locals_ - (intptr_t)this,
           // GC area has only 1 pointer
           NumLocals),
-      nativeCode(nullptr), uid(UUID::random()), funInvocationCount(0),
-      deoptCount(0), src(src), stackLength(0), localsCount(localsCnt),
-      bindingCacheSize(bindingsCnt), codeSize(cs), srcLength(sourceLength),
-      extraPoolSize(0) {
+      nativeCode(nullptr), nativeCodeUnboxed(nullptr), unboxedSignature(0),
+      uid(UUID::random()), funInvocationCount(0), directCalls(0),
+      deoptCount(0), samples(0), sampleEpoch(0), src(src), stackLength(0),
+      localsCount(localsCnt), bindingCacheSize(bindingsCnt), codeSize(cs),
+      srcLength(sourceLength), extraPoolSize(0) {
     setEntry(0, R_NilValue);
     allCodes.emplace(uid, this);
 }
@@ -80,9 +101,19 @@ Code* Code::deserialize(SEXP refTable, R_inpstream_t inp) {
     PROTECT(store);
     Code* code = new (DATAPTR(store)) Code;
     code->uid = UUID::deserialize(refTable, inp);
+    if (freshUids) {
+        auto fresh = UUID::random();
+        freshUids->emplace(code->uid, fresh);
+        code->uid = fresh;
+    }
     code->nativeCode = nullptr; // not serialized for now
+    code->nativeCodeUnboxed = nullptr;
+    code->unboxedSignature = 0;
     code->funInvocationCount = InInteger(inp);
+    code->directCalls = 0;
     code->deoptCount = InInteger(inp);
+    code->samples = 0;
+    code->sampleEpoch = 0;
     code->src = InInteger(inp);
     code->stackLength = InInteger(inp);
     *const_cast<unsigned*>(&code->localsCount) = InInteger(inp);
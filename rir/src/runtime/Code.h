@@ -7,6 +7,7 @@
 #include "utils/UUID.h"
 
 #include <cassert>
+#include <climits>
 #include <cstdint>
 #include <ostream>
 
@@ -47,10 +48,16 @@ typedef SEXP (*NativeCode)(Code*, void*, SEXP, SEXP);
 struct Code : public RirRuntimeObject<Code, CODE_MAGIC> {
     friend class FunctionWriter;
     friend class CodeVerifier;
-    static constexpr size_t NumLocals = 2;
+    static constexpr size_t NumLocals = 4;
 
     static Code* withUid(UUID uid);
 
+    // Between these calls deserialized code gets a fresh uid. References to
+    // the serialized uids are translated, thus the same data can be loaded
+    // multiple times.
+    static void beginFreshUids();
+    static void endFreshUids();
+
     Code(FunctionSEXP fun, unsigned src, unsigned codeSize, unsigned sourceSize,
          size_t localsCnt, size_t bindingsCacheSize);
     ~Code();
@@ -58,14 +65,24 @@ struct Code : public RirRuntimeObject<Code, CODE_MAGIC> {
   private:
     Code() : Code(NULL, 0, 0, 0, 0, 0) {}
     /*
-     * This array contains the GC reachable pointers. Currently there are two
+     * This array contains the GC reachable pointers. Currently there are four
      * of them.
      * 0 : the extra pool for attaching additional GC'd object to the code.
+     * 1 : the pir type feedback of the native code
+     * 2 : a handle releasing the machine code of the native code, once the
+     *     code object is collected (see JitLLVM::attach)
+     * 3 : the continuation compiled for a hot loop of this code (see
+     *     rirOptContinuation)
      */
     SEXP locals_[NumLocals];
 
   public:
     NativeCode nativeCode;
+    // Entry point of the native code taking scalar arguments and returning a
+    // scalar result unboxed. Its calling convention is encoded in
+    // unboxedSignature (0 if there is none), see pir::UnboxedSignature.
+    void* nativeCodeUnboxed;
+    uint64_t unboxedSignature;
 
     static unsigned pad4(unsigned sizeInBytes) {
         unsigned x = sizeInBytes % 4;
@@ -78,6 +95,8 @@ struct Code : public RirRuntimeObject<Code, CODE_MAGIC> {
     }
 
     void registerInvocation() {
+        // The heuristics need to see the new count, see DirectCallBudget
+        directCalls = 0;
         if (funInvocationCount < UINT_MAX)
             funInvocationCount++;
     }
@@ -87,6 +106,19 @@ struct Code : public RirRuntimeObject<Code, CODE_MAGIC> {
             deoptCount++;
     }
 
+    // Samples decay with the epoch of the profiler, see RuntimeProfiler
+    void registerSample(unsigned epoch) {
+        samples = recentSamples(epoch);
+        sampleEpoch = epoch;
+        if (samples < UINT_MAX)
+            samples++;
+    }
+
+    unsigned recentSamples(unsigned epoch) const {
+        auto age = epoch - sampleEpoch;
+        return age >= sizeof(samples) * CHAR_BIT ? 0 : samples >> age;
+    }
+
     PirTypeFeedback* pirTypeFeedback() const {
         SEXP map = getEntry(1);
         if (!map)
@@ -97,20 +129,35 @@ struct Code : public RirRuntimeObject<Code, CODE_MAGIC> {
         setEntry(1, map->container());
     }
 
+    SEXP nativeCodeHandle() const { return getEntry(2); }
+    void nativeCodeHandle(SEXP handle) { setEntry(2, handle); }
+
+    SEXP osrContinuation() const { return getEntry(3); }
+    void osrContinuation(SEXP cont) { setEntry(3, cont); }
+
     // UID for persistence when serializing/deserializing
     UUID uid;
 
     // number of invocations. only incremented if this code object is the body
     // of a function
     unsigned funInvocationCount;
+    // number of calls native code can still make directly, without the
+    // trampoline, see DirectCallBudget. not serialized.
+    unsigned directCalls;
     unsigned deoptCount;
+    // number of profiler samples with this (native) code on the stack, see
+    // PIR_ENABLE_PROFILER. halved every profiler epoch. not serialized.
+    unsigned samples;
+    unsigned sampleEpoch;
 
     enum Flag {
         NeedsFullEnv,
         Reoptimise,
+        NativeTierUp, // Native code is unoptimized, recompile once hot
+        NoOsr,        // Compiling a continuation of a hot loop failed
 
         FIRST = NeedsFullEnv,
-        LAST = Reoptimise
+        LAST = NoOsr
     };
 
     EnumSet<Flag> flags;
@@ -40,20 +40,36 @@ struct DispatchTable
     }
 
     Function* dispatch(Context a) const {
-        for (size_t i = 1; i < size(); ++i) {
+        auto key = a.toI();
+        for (size_t i = 0; i < dispatchCacheSize_; ++i)
+            if (dispatchCache_[i].context == key)
+                return get(dispatchCache_[i].idx);
+
+        size_t i = 1;
+        for (; i < size(); ++i) {
 #ifdef DEBUG_DISPATCH
             std::cout << "DISPATCH trying: " << a << " vs " << get(i)->context()
                       << "\n";
 #endif
             if (a.smaller(get(i)->context()))
-                return get(i);
+                break;
         }
-        return baseline();
+        if (i == size())
+            i = 0;
+
+        auto& entry = dispatchCacheSize_ < DISPATCH_CACHE_SIZE
+                          ? dispatchCache_[dispatchCacheSize_++]
+                          : dispatchCache_[dispatchCacheNext_++ %
+                                           DISPATCH_CACHE_SIZE];
+        entry.context = key;
+        entry.idx = i;
+        return get(i);
     }
 
     void baseline(Function* f) {
         assert(f->signature().optimization ==
                FunctionSignature::OptimizationLevel::Baseline);
+        flushDispatchCache();
         if (size() == 0)
             size_++;
         else
@@ -77,7 +93,8 @@ struct DispatchTable
         }
         if (i == size())
             return;
-        get(i)->flags.set(Function::Dead);
+        flushDispatchCache();
+        get(i)->markDead();
         for (; i < size() - 1; ++i) {
             setEntry(i, getEntry(i + 1));
         }
@@ -91,6 +108,7 @@ struct DispatchTable
         assert(size() > 0);
         assert(fun->signature().optimization !=
                FunctionSignature::OptimizationLevel::Baseline);
+        flushDispatchCache();
         auto assumptions = fun->context();
         long i;
         for (i = size() - 1; i > 0; --i) {
@@ -98,7 +116,7 @@ struct DispatchTable
                 // If we override a version we should ensure that we don't call
                 // the old version anymore, or we might end up in a deopt loop.
                 if (i != 0) {
-                    get(i)->flags.set(Function::Dead);
+                    get(i)->markDead();
                     setEntry(i, fun->container());
                     assert(get(i) == fun);
                 }
@@ -121,8 +139,13 @@ struct DispatchTable
             std::cout << "Tried to insert: " << assumptions << "\n";
             Rf_error("dispatch table overflow");
 #endif
-            // Evict one element and retry
-            auto pos = 1 + (std::rand() % (size() - 1));
+            // Evict the least used version and retry
+            size_t pos = 1;
+            for (size_t j = 2; j < size(); ++j)
+                if (get(j)->invocationCount() < get(pos)->invocationCount())
+                    pos = j;
+            // Native code might still call the evicted version directly
+            get(pos)->markDead();
             size_--;
             while (pos < size()) {
                 setEntry(pos, getEntry(pos + 1));
@@ -192,6 +215,23 @@ struct DispatchTable
               cap) {}
 
     size_t size_ = 0;
+
+    // Small polymorphic cache in front of dispatch, keyed by the packed
+    // context. Entries are indices into the table, thus every change to the
+    // table flushes it.
+    static constexpr size_t DISPATCH_CACHE_SIZE = 4;
+    struct DispatchCacheEntry {
+        unsigned long context;
+        size_t idx;
+    };
+    mutable DispatchCacheEntry dispatchCache_[DISPATCH_CACHE_SIZE];
+    mutable size_t dispatchCacheSize_ = 0;
+    mutable size_t dispatchCacheNext_ = 0;
+
+    void flushDispatchCache() {
+        dispatchCacheSize_ = 0;
+        dispatchCacheNext_ = 0;
+    }
 };
 #pragma pack(pop)
 } // namespace rir
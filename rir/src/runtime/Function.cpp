@@ -13,8 +13,10 @@ Function* Function::deserialize(SEXP refTable, R_inpstream_t inp) {
     Function* fun = new (payload) Function(functionSize, NULL, {}, sig, as);
     fun->numArgs_ = InInteger(inp);
     fun->info.gc_area_length += fun->numArgs_;
-    for (unsigned i = 0; i < fun->numArgs_ + 1; i++) {
-        fun->setEntry(i, R_NilValue);
+    // The side objects stay null, they are not serialized
+    fun->setEntry(0, R_NilValue);
+    for (unsigned i = 0; i < fun->numArgs_; i++) {
+        fun->setEntry(Function::NUM_PTRS + i, R_NilValue);
     }
     PROTECT(store);
     AddReadRef(refTable, store);
@@ -20,11 +20,71 @@ typedef SEXP FunctionSEXP;
 // magic in his vector too...
 #define FUNCTION_MAGIC (unsigned)0xca11ab1e
 
+/** Compile time and deopt telemetry of one function version, reported by
+ *  rir.stats(). Times are in seconds. This is runtime state only, it is not
+ *  serialized. Allocated on first use, see Function::stats.
+ */
+struct FunctionStats {
+    double rir2pirTime = 0;
+    double optTime = 0;
+    double pir2rirTime = 0;
+    double llvmTime = 0;
+    unsigned deoptReasons[DeoptReason::NumReasons] = {};
+    // Calls to a closure with `...` whose arguments were matched at runtime,
+    // and those of them which still ran in the baseline (baseline only)
+    unsigned argmatchUsed = 0;
+    unsigned argmatchWasted = 0;
+    // Invocations continued in an optimized loop continuation, see PIR_OSR
+    // (baseline only)
+    unsigned osrEntries = 0;
+};
+
+/** Recent deopt sites of a closure, kept in its baseline version. A site is
+ *  identified by its (baseline) source code and the offset of the feedback
+ *  which was speculated on. Once a site repeatedly deopts, the deopt policy
+ *  disables that speculation (see registerDeoptReason) and its deopts no
+ *  longer count towards PIR_DEOPT_ABANDON. Allocated on the first deopt,
+ *  see Function::deoptHistory.
+ */
+struct DeoptHistory {
+    static constexpr size_t NumSites = 8;
+    struct Site {
+        const Code* srcCode = nullptr;
+        uint32_t originOffset = 0;
+        unsigned count = 0;
+    };
+    std::array<Site, NumSites> sites;
+    unsigned forgiven = 0;
+
+    // Returns the site of the reason, creating (or recycling the least
+    // deoptimizing) entry if it was not seen before
+    Site& site(const DeoptReason& reason) {
+        Site* res = &sites[0];
+        for (auto& s : sites) {
+            if (s.srcCode == reason.srcCode &&
+                s.originOffset == reason.originOffset)
+                return s;
+            if (s.count < res->count)
+                res = &s;
+        }
+        *res = Site();
+        res->srcCode = reason.srcCode;
+        res->originOffset = reason.originOffset;
+        return *res;
+    }
+
+    void forgive(Site& s) {
+        forgiven += s.count;
+        s = Site();
+    }
+};
+
 /** A RIR function represents GNU R function.
  *
  *  Each function start with a header and some metadata. Then there are
- *  (GC traceable) pointers to the body and the compiled default arguments.
- *  If an argument has no default, the default arg is null.
+ *  (GC traceable) pointers to the body, the telemetry side objects and the
+ *  compiled default arguments. If an argument has no default, the default arg
+ *  is null. The side objects are null until something is recorded.
  *
  *  A Function may be the result of optimizing another
  *  Function, in which case the origin field stores that
@@ -39,7 +99,7 @@ struct Function : public RirRuntimeObject<Function, FUNCTION_MAGIC> {
     friend class FunctionCodeIterator;
     friend class ConstFunctionCodeIterator;
 
-    static constexpr size_t NUM_PTRS = 1;
+    static constexpr size_t NUM_PTRS = 3;
 
     Function(size_t functionSize, SEXP body_,
              const std::vector<SEXP>& defaultArgs,
@@ -71,9 +131,53 @@ struct Function : public RirRuntimeObject<Function, FUNCTION_MAGIC> {
 
     void unregisterInvocation() { body()->unregisterInvocation(); }
     void registerInvocation() { body()->registerInvocation(); }
+    // Native code calls this version through the trampoline again, which
+    // checks its flags, see DirectCallBudget
+    void disableDirectCalls() { body()->directCalls = 0; }
+    void markDead() {
+        flags.set(Dead);
+        disableDirectCalls();
+    }
     size_t invocationCount() { return body()->funInvocationCount; }
     void registerDeopt() { body()->registerDeopt(); }
     size_t deoptCount() { return body()->deoptCount; }
+    void registerDeoptReason(DeoptReason::Reason r) {
+        auto& s = sideObject<FunctionStats>(STATS_PTR);
+        if (s.deoptReasons[r] < UINT_MAX)
+            s.deoptReasons[r]++;
+    }
+
+    void registerDotsArgmatch(bool wasted) {
+        auto& s = sideObject<FunctionStats>(STATS_PTR);
+        auto& count = wasted ? s.argmatchWasted : s.argmatchUsed;
+        if (count < UINT_MAX)
+            count++;
+    }
+
+    void registerOsrEntry() {
+        auto& s = sideObject<FunctionStats>(STATS_PTR);
+        if (s.osrEntries < UINT_MAX)
+            s.osrEntries++;
+    }
+
+    // nullptr if nothing was recorded for this version
+    const FunctionStats* stats() const {
+        return sideObjectIfAny<FunctionStats>(STATS_PTR);
+    }
+    void stats(const FunctionStats& s) {
+        sideObject<FunctionStats>(STATS_PTR) = s;
+    }
+    // Only the baseline version keeps a history, see registerDeoptReason
+    DeoptHistory& deoptHistory() {
+        return sideObject<DeoptHistory>(DEOPT_HISTORY_PTR);
+    }
+
+    // Deopts counting towards PIR_DEOPT_ABANDON
+    size_t unforgivenDeoptCount() {
+        auto history = sideObjectIfAny<DeoptHistory>(DEOPT_HISTORY_PTR);
+        size_t forgiven = history ? history->forgiven : 0;
+        return deoptCount() > forgiven ? deoptCount() - forgiven : 0;
+    }
 
     unsigned size; /// Size, in bytes, of the function and its data
 
@@ -122,13 +226,32 @@ struct Function : public RirRuntimeObject<Function, FUNCTION_MAGIC> {
     const Context& context() const { return context_; }
 
   private:
+    static constexpr size_t STATS_PTR = 1;
+    static constexpr size_t DEOPT_HISTORY_PTR = 2;
+
+    template <typename T>
+    const T* sideObjectIfAny(size_t i) const {
+        auto s = getEntry(i);
+        return s ? reinterpret_cast<const T*>(RAW(s)) : nullptr;
+    }
+    template <typename T>
+    T& sideObject(size_t i) {
+        auto s = getEntry(i);
+        if (!s) {
+            s = Rf_allocVector(RAWSXP, sizeof(T));
+            new (RAW(s)) T();
+            setEntry(i, s);
+        }
+        return *reinterpret_cast<T*>(RAW(s));
+    }
+
     unsigned numArgs_;
 
     FunctionSignature signature_; /// pointer to this version's signature
     Context context_;
 
     // !!! SEXPs traceable by the GC must be declared here !!!
-    // locals contains: origin, next, body
+    // locals contains: body, stats, deopt history
     CodeSEXP locals[NUM_PTRS];
     CodeSEXP defaultArg_[];
 };
@@ -70,6 +70,7 @@ struct FunctionSignature {
         unsigned numArgs = InInteger(inp);
         FunctionSignature sig(envc, opt);
         sig.numArguments = numArgs;
+        sig.hasDotsFormals = InInteger(inp);
         return sig;
     }
 
@@ -77,6 +78,7 @@ struct FunctionSignature {
         OutInteger(out, (int)envCreation);
         OutInteger(out, (int)optimization);
         OutInteger(out, numArguments);
+        OutInteger(out, hasDotsFormals);
     }
 
     void pushDefaultArgument() { numArguments++; }
@@ -100,6 +102,8 @@ struct FunctionSignature {
     const Environment envCreation;
     const OptimizationLevel optimization;
     unsigned numArguments = 0;
+    // One of the formals is `...`, see dotsArgmatchedCall
+    bool hasDotsFormals = false;
 };
 
 } // namespace rir
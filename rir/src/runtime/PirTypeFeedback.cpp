@@ -56,6 +56,30 @@ PirTypeFeedback::PirTypeFeedback(
     }
 }
 
+PirTypeFeedback* PirTypeFeedback::cloneLayout() const {
+    size_t entries = 0;
+    for (auto e : entry)
+        if (e < MAX_SLOT_IDX && e >= entries)
+            entries = e + 1;
+
+    auto origins = info.gc_area_length;
+    SEXP cont = Rf_allocVector(EXTERNALSXP, requiredSize(origins, entries));
+    auto res = reinterpret_cast<PirTypeFeedback*>(DATAPTR(cont));
+    // Header and the slot to entry map
+    memcpy(res, this, sizeof(*this));
+    memset((uint8_t*)res + info.gc_area_start, 0, origins * sizeof(SEXP));
+    for (size_t i = 0; i < origins; ++i)
+        res->setEntry(i, getEntry(i));
+    for (size_t i = 0; i < entries; ++i) {
+        auto& from = mdEntries()[i];
+        auto& to = *new (&res->mdEntries()[i]) MDEntry;
+        to.srcCode = from.srcCode;
+        to.offset = from.offset;
+        to.previousType = from.previousType;
+    }
+    return res;
+}
+
 Code* PirTypeFeedback::getSrcCodeOfSlot(size_t slot) {
     auto code = getEntry(getMDEntryOfSlot(slot).srcCode);
     return Code::unpack(code);
@@ -41,6 +41,10 @@ struct PirTypeFeedback
         const std::unordered_set<Code*>& codes,
         const std::unordered_map<size_t, const pir::TypeFeedback&>& slots);
 
+    // A new object with the same slots and origins, but without samples. For
+    // native code shared between code objects, see JitLLVM::recall.
+    PirTypeFeedback* cloneLayout() const;
+
     ObservedValues& getSampleOfSlot(size_t slot) {
         return getMDEntryOfSlot(slot).feedback;
     }
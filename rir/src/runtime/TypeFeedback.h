@@ -19,7 +19,7 @@ static const R_xlen_t MAX_SIZE_OF_VECTOR_FOR_NAN_CHECK = 1;
 #pragma pack(1)
 
 struct ObservedCallees {
-    static constexpr unsigned CounterBits = 30;
+    static constexpr unsigned CounterBits = 29;
     static constexpr unsigned CounterOverflow = (1 << CounterBits) - 1;
     static constexpr unsigned TargetBits = 2;
     static constexpr unsigned MaxTargets = (1 << TargetBits) - 1;
@@ -30,6 +30,8 @@ struct ObservedCallees {
     // different targets and the case where we have seen more than that.
     // Effectively this means we have seen MaxTargets or more.
     uint32_t numTargets : TargetBits;
+    // Set by the deopt policy when speculating on the target keeps failing
+    uint32_t speculationDisabled : 1;
     uint32_t taken : CounterBits;
 
     void record(Code* caller, SEXP callee);
@@ -117,13 +119,15 @@ struct ObservedValues {
     static constexpr unsigned MaxTypes = 3;
     uint8_t numTypes : 2;
     uint8_t stateBeforeLastForce : 2;
-    uint8_t unused : 4;
+    // Set by the deopt policy when speculating on the type keeps failing
+    uint8_t speculationDisabled : 1;
+    uint8_t unused : 3;
 
     std::array<ObservedType, MaxTypes> seen;
 
     ObservedValues()
         : numTypes(0), stateBeforeLastForce(StateBeforeLastForce::unknown),
-          unused(0) {}
+          speculationDisabled(0), unused(0) {}
 
     void reset() { *this = ObservedValues(); }
 
@@ -210,6 +214,7 @@ struct DeoptReason {
         EnvStubMaterialized,
         DeadBranchReached,
     };
+    static constexpr unsigned NumReasons = DeadBranchReached + 1;
     Reason reason;
     Code* srcCode;
     uint32_t originOffset;
@@ -0,0 +1,95 @@
+#ifndef RIR_BIT_VECTOR_H
+#define RIR_BIT_VECTOR_H
+
+#include <cstdint>
+#include <vector>
+
+namespace rir {
+
+/*
+ * A growable set of small integers (e.g. densely numbered values), stored as a
+ * bit per element.
+ */
+class BitVector {
+    typedef uint64_t Word;
+    static constexpr size_t BITS = 64;
+
+    std::vector<Word> words;
+
+  public:
+    BitVector() {}
+    explicit BitVector(size_t size) : words((size + BITS - 1) / BITS, 0) {}
+
+    bool test(size_t i) const {
+        return i / BITS < words.size() && (words[i / BITS] >> (i % BITS)) & 1;
+    }
+
+    // Returns true if i was not in the set before
+    bool set(size_t i) {
+        if (i / BITS >= words.size())
+            words.resize(i / BITS + 1, 0);
+        auto& w = words[i / BITS];
+        Word bit = (Word)1 << (i % BITS);
+        if (w & bit)
+            return false;
+        w |= bit;
+        return true;
+    }
+
+    // Returns true if i was in the set before
+    bool reset(size_t i) {
+        if (i / BITS >= words.size())
+            return false;
+        auto& w = words[i / BITS];
+        Word bit = (Word)1 << (i % BITS);
+        if (!(w & bit))
+            return false;
+        w &= ~bit;
+        return true;
+    }
+
+    // Adds all elements of other, returns true if any was new
+    bool merge(const BitVector& other) {
+        if (other.words.size() > words.size())
+            words.resize(other.words.size(), 0);
+        bool changed = false;
+        for (size_t i = 0; i < other.words.size(); ++i) {
+            auto w = words[i] | other.words[i];
+            if (w != words[i]) {
+                words[i] = w;
+                changed = true;
+            }
+        }
+        return changed;
+    }
+
+    bool empty() const {
+        for (auto w : words)
+            if (w)
+                return false;
+        return true;
+    }
+
+    // Smallest element, the set must not be empty
+    size_t first() const {
+        for (size_t i = 0; i < words.size(); ++i)
+            if (words[i])
+                return i * BITS + __builtin_ctzll(words[i]);
+        return -1;
+    }
+
+    template <typename F>
+    void forEach(F f) const {
+        for (size_t i = 0; i < words.size(); ++i) {
+            auto w = words[i];
+            while (w) {
+                f(i * BITS + __builtin_ctzll(w));
+                w &= w - 1;
+            }
+        }
+    }
+};
+
+} // namespace rir
+
+#endif
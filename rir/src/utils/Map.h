@@ -22,6 +22,7 @@ class SmallMap {
     SmallMap() {}
 
     bool empty() const { return container.empty(); }
+    size_t size() const { return container.size(); }
     size_t count(const K& k) const { return contains(k) ? 1 : 0; }
 
     void checkSize() {
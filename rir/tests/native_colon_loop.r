@@ -0,0 +1,26 @@
+# Loops over long ranges built by `:` in native code. The range is a plain
+# vector there, such that the element accesses stay on the fast paths.
+
+f <- function(x, n) {
+    s <- 0
+    for (i in 1:n)
+        s <- s + x[i] * x[[n - i + 1L]]
+    s
+}
+g <- rir.compile(f)
+x <- as.numeric(1:200)
+for (i in 1:3) g(x, 10L)
+pir.compile(g)
+for (n in c(1L, 63L, 64L, 65L, 200L))
+    stopifnot(identical(f(x, n), g(x, n)))
+
+range <- rir.compile(function(a, b) a:b)
+for (i in 1:3) range(1L, 100L)
+pir.compile(range)
+stopifnot(identical(range(1L, 100L), 1:100))
+stopifnot(identical(range(100L, 1L), 100:1))
+if (Sys.getenv("PIR_NATIVE_BACKEND", unset = "1") != "0" &&
+    Sys.getenv("PIR_ENABLE", unset = "on") == "on" &&
+    any(rir.stats(range)$native))
+    stopifnot(!any(grepl("compact",
+                         capture.output(.Internal(inspect(range(1L, 100L)))))))
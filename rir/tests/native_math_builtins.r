@@ -0,0 +1,46 @@
+f <- function(a) list(sqrt(a), exp(a), floor(a), ceiling(a), sin(a), cos(a),
+                      log2(a), log10(a))
+g <- rir.compile(f)
+for (i in 1:3) g(c(1.5, 2))
+pir.compile(g)
+
+check <- function(a)
+    stopifnot(identical(suppressWarnings(f(a)), suppressWarnings(g(a))))
+
+check(c(1.5, 2, 4))
+check(1:10)
+check(c(TRUE, NA, FALSE))
+check(c(0.25, NA, NaN, Inf, -Inf))
+check(c(1L, NA))
+check(c(a = 2.5, b = 9))
+check(numeric(0))
+
+# NaNs produced from numbers warn
+w <- tryCatch(g(-1:1), warning = function(w) w)
+stopifnot(inherits(w, "warning"))
+
+# Scalars in a loop
+h <- rir.compile(function(n) {
+    s <- 0
+    for (i in 1:n)
+        s <- s + sqrt(i) + floor(i / 3) + exp(-i) + cos(i)
+    s
+})
+for (i in 1:3) h(10)
+pir.compile(h)
+stopifnot(all.equal(h(100), sum(sqrt(1:100) + floor(1:100 / 3) +
+                                exp(-(1:100)) + cos(1:100))))
+
+k <- rir.compile(function(x) sqrt(x))
+for (i in 1:3) k(4)
+pir.compile(k)
+stopifnot(identical(k(4), 2))
+stopifnot(is.nan(suppressWarnings(k(-1))))
+w <- tryCatch(k(-1), warning = function(w) w)
+stopifnot(inherits(w, "warning"))
+
+# Compact sequences (ALTREP) allocate when their data is accessed
+gctorture(TRUE)
+r <- g(1:100)
+gctorture(FALSE)
+stopifnot(identical(r, f(1:100)))
@@ -0,0 +1,35 @@
+f <- function(a, b) list(a + b, a - b, a * b, a / b,
+                         a == b, a != b, a < b, a <= b, a > b, a >= b)
+g <- rir.compile(f)
+for (i in 1:3) g(1:4, 2)
+pir.compile(g)
+
+check <- function(a, b)
+    stopifnot(identical(f(a, b), g(a, b)))
+
+check(1:10, 10:1)
+check(c(1L, NA, 3L), 2L)
+check(c(1.5, NA, NaN, Inf), c(2, 2))
+check(c(1L, NA, 3L, 4L), c(0.5, NA))
+check(1:6, c(1L, NA, -1L))
+check(3, c(1, 2, NA, 0))
+check(c(a = 1, b = 2), 3)
+check(1:3, numeric(0))
+check(1:5, 1:2)
+
+# integer overflow gives NA and warns
+w <- tryCatch(g(.Machine$integer.max, 1:2), warning = function(w) w)
+stopifnot(inherits(w, "warning"))
+stopifnot(identical(suppressWarnings(g(.Machine$integer.max, 1:2)),
+                    suppressWarnings(f(.Machine$integer.max, 1:2))))
+
+# Compact sequences (ALTREP) allocate when their data is accessed
+x <- 1:100
+y <- seq_len(100)
+check(x, rev(x))
+check(x, 0.5)
+check(2.5, y)
+gctorture(TRUE)
+r <- g(x, y)
+gctorture(FALSE)
+stopifnot(identical(r, f(1:100, seq_len(100))))
@@ -0,0 +1,26 @@
+f <- function(a, b, c) list(a * b + c, (a - b) / (c + 1), a + b * 2L - c)
+g <- rir.compile(f)
+for (i in 1:3) g(c(1, 2, 3), c(4, 5, 6), 2)
+pir.compile(g)
+
+check <- function(a, b, c)
+    stopifnot(identical(f(a, b, c), g(a, b, c)))
+
+check(c(1, 2, 3), c(4, 5, 6), 2)
+check(1:600, 600:1, 3L)
+check(c(1L, NA, 3L), c(0.5, 1, NA), c(NaN, Inf, -1))
+check(c(a = 1, b = 2), 3, 4)
+check(1:6, 1:2, 1:3)
+check(numeric(0), 1, 2)
+
+# integer overflow gives NA and warns
+w <- tryCatch(g(.Machine$integer.max, 1:2, 1L), warning = function(w) w)
+stopifnot(inherits(w, "warning"))
+stopifnot(identical(suppressWarnings(g(.Machine$integer.max, 1:2, 1L)),
+                    suppressWarnings(f(.Machine$integer.max, 1:2, 1L))))
+
+# Compact sequences (ALTREP) allocate when their data is accessed
+gctorture(TRUE)
+r <- g(1:300, seq_len(300), 2)
+gctorture(FALSE)
+stopifnot(identical(r, f(1:300, seq_len(300), 2)))